@@ -6,6 +6,7 @@
  */
 #include "tss.h"
 #include "pmm.h"
+#include "vmm.h"
 #include "terminal.h"
 // Forward declaration of print_hex defined in kernel.c
 extern void print_hex(uint64_t value);
@@ -56,16 +57,22 @@ static void gdt_set_tss(uint64_t base, uint32_t limit) {
 }
 
 void tss_init(void) {
-    // Allocate IST stacks
-    ist1_stack = (uint8_t*)pmm_alloc_frame();  // Double Fault
-    ist2_stack = (uint8_t*)pmm_alloc_frame();  // Page Fault
-    ist3_stack = (uint8_t*)pmm_alloc_frame();  // General Protection Fault
+    // Allocate IST stacks (any frame: runs after vmm_init_physmap, used through the physmap)
+    void* ist1_frame = pmm_alloc_frame();  // Double Fault
+    void* ist2_frame = pmm_alloc_frame();  // Page Fault
+    void* ist3_frame = pmm_alloc_frame();  // General Protection Fault
     
-    if (!ist1_stack || !ist2_stack || !ist3_stack) {
+    if (!ist1_frame || !ist2_frame || !ist3_frame) {
         terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_RED, VGA_COLOR_BLACK));
         terminal_writestring("[ERROR] Impossibile allocare stack IST!\n");
         return;
     }
+    pmm_page_set_flags((uint64_t)ist1_frame, PMM_PAGE_KERNEL | PMM_PAGE_PINNED);
+    pmm_page_set_flags((uint64_t)ist2_frame, PMM_PAGE_KERNEL | PMM_PAGE_PINNED);
+    pmm_page_set_flags((uint64_t)ist3_frame, PMM_PAGE_KERNEL | PMM_PAGE_PINNED);
+    ist1_stack = (uint8_t*)phys_to_virt((uint64_t)ist1_frame);
+    ist2_stack = (uint8_t*)phys_to_virt((uint64_t)ist2_frame);
+    ist3_stack = (uint8_t*)phys_to_virt((uint64_t)ist3_frame);
     
     // Azzera il TSS
     uint8_t* tss_ptr = (uint8_t*)&tss;
@@ -10,7 +10,19 @@
 #define ENABLE_RTC      1   // Da implementare
 #define ENABLE_FB       1   // Framebuffer grafico attivo (richiede header multiboot con richiesta framebuffer)
 
+// Physical allocator: 1 = buddy free lists, 0 = two-level summary bitmap (tzcnt + next-fit)
+#define PMM_USE_BUDDY   1
+// Page colouring: number of LLC colours (LLC size / associativity / 4KB), power of two
+// between 2 and 64. 0 disables coloured allocation (colour masks are then ignored).
+#define PMM_COLOURS     32
+// Deferred frame metadata init: RAM above the identity map (512MB) is set up one 128MB
+// section at a time, on first allocation or from the idle loop. 0 = everything at boot.
+#define PMM_DEFERRED_INIT 1
+
 // Verbose logging
 #define ENABLE_DEBUG_LOG 0
+// Heap profiler: caller and size of every live kmalloc/vmalloc/kmem_cache object in a
+// 4096-slot hash table (128KB), shown by 'heapprof'. 0 = hooks compiled out.
+#define ENABLE_HEAP_PROFILE 0
 
 #endif // CONFIG_H
@@ -10,6 +10,7 @@
 #include "terminal.h" // VGA color enum
 #include "fb.h"
 #include "vmm.h" // phys_to_virt
+#include "heap.h" // vmalloc for the back buffer
 #include "timer.h" // timer callback registration for blink
 #include <stddef.h>
 #include <stdint.h>
@@ -558,9 +559,8 @@ void fb_console_write(const char* s){ while(*s) fb_console_putc(*s++); }
 int fb_console_enable_dbuf(void){
     if(!fb_enabled) return -1;
     if(dbuf_enabled) return 0;
-    // Simple allocation via kmalloc (requires working heap)
-    extern void* kmalloc(size_t sz); extern void kfree(void* p);
-    size_t sz = fb_pitch * fb_height; dbuf = (uint8_t*)kmalloc(sz);
+    size_t sz = fb_pitch * fb_height;
+    dbuf = (uint8_t*)vmalloc(sz);
     if(!dbuf) return -1;
     // Copy existing content
     uint8_t* base=(uint8_t*)(uint64_t)fb_phys_addr;
@@ -570,10 +570,10 @@ int fb_console_enable_dbuf(void){
 }
 void fb_console_disable_dbuf(void){
     if(!dbuf_enabled) return;
-    extern void kfree(void* p);
     // Final flush before freeing
     fb_console_flush();
-    kfree(dbuf); dbuf=NULL; dbuf_enabled=0;
+    vfree(dbuf);
+    dbuf=NULL; dbuf_enabled=0;
 }
 void fb_console_flush(void){
     if(!dbuf_enabled || !dbuf) return; uint8_t* base=(uint8_t*)(uint64_t)fb_phys_addr;
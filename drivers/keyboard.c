@@ -5,6 +5,7 @@
  * SPDX-License-Identifier: MIT
  */
 #include "keyboard.h"
+#include "sched.h" // sched_idle
 
 #define KEYBOARD_DATA_PORT 0x60
 #define BUFFER_SIZE 256
@@ -122,7 +123,7 @@ void keyboard_init(void) {
 // Read a character (blocking)
 char keyboard_getchar(void) {
     while (!keyboard_has_char()) {
-    __asm__ volatile ("hlt");  // Wait for interrupt
+        sched_idle();  // Idle work, then wait for interrupt
     }
     return buffer_get();
 }
@@ -14,6 +14,7 @@
 // Tick counter
 static volatile uint64_t timer_ticks = 0;
 static uint32_t timer_frequency = 0;
+static uint64_t tsc_tick1 = 0; // TSC al primo tick (calibrazione)
 // Registered tick callbacks (simple static array)
 #define MAX_TICK_CBS 8
 static timer_tick_cb_t tick_cbs[MAX_TICK_CBS];
@@ -33,6 +34,7 @@ static inline uint8_t inb(uint16_t port) {
 // Timer interrupt handler (IRQ0)
 void timer_handler(void) {
     timer_ticks++;
+    if (timer_ticks == 1) tsc_tick1 = timer_rdtsc();
     sched_on_timer_tick();
     // Execute registered callbacks
     for(int i=0;i<tick_cb_count;i++) {
@@ -82,6 +84,14 @@ uint32_t timer_get_frequency(void) {
     return timer_frequency;
 }
 
+// Frequenza TSC in kHz misurata sui tick PIT (0 finche' non sono trascorsi ~10ms)
+uint64_t timer_tsc_khz(void) {
+    uint64_t t = timer_ticks;
+    if (!timer_frequency || t < 11) return 0;
+    uint64_t ms = (t - 1) * 1000 / timer_frequency;
+    return ms ? (timer_rdtsc() - tsc_tick1) / ms : 0;
+}
+
 int timer_register_tick_callback(timer_tick_cb_t cb) {
     if (tick_cb_count >= MAX_TICK_CBS) return -1;
     tick_cbs[tick_cb_count++] = cb;
@@ -92,7 +102,7 @@ int timer_register_tick_callback(timer_tick_cb_t cb) {
 void timer_sleep(uint32_t ticks) {
     uint64_t target = timer_ticks + ticks;
     while (timer_ticks < target) {
-        __asm__ volatile ("hlt");  // Attendi interrupt
+        sched_idle();  // Lavoro idle, poi attendi interrupt
     }
 }
 
@@ -31,8 +31,18 @@ void timer_sleep_ms(uint32_t ms);
 // Ottieni la frequenza del timer
 uint32_t timer_get_frequency(void);
 
+// Frequenza TSC in kHz calibrata sul PIT (0 se non ancora disponibile)
+uint64_t timer_tsc_khz(void);
+
 // Registrazione callback tick (chiamato ogni interrupt timer)
 typedef void (*timer_tick_cb_t)(void);
 int timer_register_tick_callback(timer_tick_cb_t cb);
 
+// Contatore cicli CPU (TSC) per misure di latenza
+static inline uint64_t timer_rdtsc(void) {
+    uint32_t lo, hi;
+    __asm__ volatile ("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
 #endif
\ No newline at end of file
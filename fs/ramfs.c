@@ -33,36 +33,44 @@ static int ramfs_add_common(const char* name, const void* data, size_t size, uns
     if(size==0){ // avoid kmalloc(0) for directories or initial empty file
         e->data = NULL;
         e->size = 0;
+        e->cap = 0;
         return 0;
     }
     if(flags & 1){ // immutable: points directly to provided data
         e->data = (uint8_t*)(uintptr_t)data;
         e->size = size;
+        e->cap = 0; // not owned
     } else {
     // copy into heap (mutable file)
         e->data = (uint8_t*)kmalloc(size);
         if(!e->data){ ramfs_count--; return -1; }
         for(size_t i=0;i<size;i++) e->data[i] = ((const uint8_t*)data)[i];
         e->size = size;
+        e->cap = size;
     }
     return 0;
 }
 int ramfs_add(const char* name, const void* data, size_t size){ return ramfs_add_common(name,data,size,0); }
 int ramfs_add_static(const char* name, const void* data, size_t size){ return ramfs_add_common(name,data,size,1); }
 
+// Make room for 'need' bytes: capacity doubles (from 64) so a sequence of appends costs
+// amortised O(1) per byte; krealloc grows the buffer in place when the heap allows it
+static int ramfs_reserve(ramfs_entry_t* e, size_t need){
+    if(need <= e->cap) return 0;
+    size_t cap = e->cap ? e->cap : 64; while(cap < need) cap *= 2;
+    uint8_t* new_buf = (uint8_t*)krealloc(e->data, cap);
+    if(!new_buf) return -1;
+    e->data = new_buf;
+    e->cap = cap;
+    return 0;
+}
+
 int ramfs_write(const char* name, size_t offset, const void* src, size_t len){
     ramfs_entry_t* e = (ramfs_entry_t*)ramfs_find(name); if(!e) return -1; if(e->flags & 1) return -1; // immutable file not writable
     if(offset > e->size) return -1; // disallow holes
     size_t end = offset + len; if(end > e->size){ // need grow
-        size_t new_size = end;
-        uint8_t* new_buf = (uint8_t*)kmalloc(new_size);
-        if(!new_buf) return -1;
-        // copy old
-        for(size_t i=0;i<e->size;i++) new_buf[i]=e->data[i];
-        // free old
-        kfree(e->data);
-        e->data = new_buf;
-        e->size = new_size;
+        if(ramfs_reserve(e, end)) return -1;
+        e->size = end;
     }
     // perform write
     for(size_t i=0;i<len;i++) e->data[offset+i] = ((const uint8_t*)src)[i];
@@ -72,12 +80,15 @@ int ramfs_write(const char* name, size_t offset, const void* src, size_t len){
 int ramfs_truncate(const char* name, size_t new_size){
     ramfs_entry_t* e = (ramfs_entry_t*)ramfs_find(name); if(!e) return -1; if(e->flags & 1) return -1; // immutable file not truncatable
     if(new_size == e->size) return 0;
-    uint8_t* new_buf = (uint8_t*)kmalloc(new_size);
-    if(!new_buf) return -1;
-    size_t copy = (new_size < e->size)? new_size : e->size;
-    for(size_t i=0;i<copy;i++) new_buf[i]=e->data[i];
-    kfree(e->data);
-    e->data = new_buf;
+    if(new_size > e->size){
+        if(ramfs_reserve(e, new_size)) return -1;
+        for(size_t i=e->size;i<new_size;i++) e->data[i]=0; // extended part reads as zeros
+    } else if(new_size == 0){
+        kfree(e->data); e->data = NULL; e->cap = 0;
+    } else if(new_size < e->cap / 4){ // give back most of the buffer
+        uint8_t* new_buf = (uint8_t*)krealloc(e->data, new_size);
+        if(new_buf){ e->data = new_buf; e->cap = new_size; }
+    }
     e->size = new_size;
     return 0;
 }
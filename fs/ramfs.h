@@ -21,6 +21,7 @@ typedef struct {
     char     name[RAMFS_NAME_MAX]; // full path (e.g. "dir/sub/file") or simple root name
     uint8_t* data; // file data (NULL for directory)
     size_t   size; // file size (0 for directory)
+    size_t   cap;  // bytes allocated for data (mutable files; >= size, grows geometrically)
     unsigned flags; // bit0 immutable, bit1 directory
 } ramfs_entry_t;
 
@@ -7,16 +7,26 @@
  */
 #include "vfs.h"
 #include "ramfs.h"
+#include "heap.h" // kmem_cache
 #include <stddef.h>
 
-// Simple inode cache: build on lookup; no eviction.
-static vfs_inode_t inode_cache[RAMFS_MAX_FILES+4];
+// Simple inode cache: build on lookup; no eviction. Inodes come from a dedicated kmem
+// cache instead of a static array, allocated only for entries actually looked up.
+static vfs_inode_t* inode_cache[RAMFS_MAX_FILES+4];
 static size_t inode_cache_used = 0;
+static kmem_cache_t* inode_kcache = NULL;
 
-static vfs_inode_t* inode_from_entry(const ramfs_entry_t* e){ if(!e) return NULL; // search cache
-    for(size_t i=0;i<inode_cache_used;i++){ if(inode_cache[i].fs_data == (void*)e) return &inode_cache[i]; }
+static vfs_inode_t* inode_new(void){
     if(inode_cache_used >= sizeof(inode_cache)/sizeof(inode_cache[0])) return NULL;
-    vfs_inode_t* ino = &inode_cache[inode_cache_used++];
+    if(!inode_kcache) inode_kcache = kmem_cache_create("ramfs_inode", sizeof(vfs_inode_t), 8, NULL);
+    vfs_inode_t* ino = (vfs_inode_t*)kmem_cache_alloc(inode_kcache);
+    if(ino) inode_cache[inode_cache_used++] = ino;
+    return ino;
+}
+
+static vfs_inode_t* inode_from_entry(const ramfs_entry_t* e){ if(!e) return NULL; // search cache
+    for(size_t i=0;i<inode_cache_used;i++){ if(inode_cache[i]->fs_data == (void*)e) return inode_cache[i]; }
+    vfs_inode_t* ino = inode_new(); if(!ino) return NULL;
     // Path already absolute in ramfs_entry_t.name (without leading '/')
     // Build canonical path with leading '/' (root = "/")
     size_t k=0; const char* src=e->name; if(!src[0]){ ino->path[0]='/'; ino->path[1]=0; } else {
@@ -36,8 +46,8 @@ static vfs_inode_t* ramfs_vfs_lookup(const char* path){
     const char* np = path;
     if(np[0]=='/' && np[1]==0){ // root
         // fabricate root inode
-        for(size_t i=0;i<inode_cache_used;i++){ if(inode_cache[i].path[0]=='/' && inode_cache[i].path[1]==0) return &inode_cache[i]; }
-        if(inode_cache_used >= sizeof(inode_cache)/sizeof(inode_cache[0])) return NULL; vfs_inode_t* root=&inode_cache[inode_cache_used++]; root->path[0]='/'; root->path[1]=0; root->type=VFS_NODE_DIR; root->size=0; root->fs_data=NULL; return root;
+        for(size_t i=0;i<inode_cache_used;i++){ if(inode_cache[i]->path[0]=='/' && inode_cache[i]->path[1]==0) return inode_cache[i]; }
+        vfs_inode_t* root=inode_new(); if(!root) return NULL; root->path[0]='/'; root->path[1]=0; root->type=VFS_NODE_DIR; root->size=0; root->fs_data=NULL; return root;
     }
     if(np[0]=='/') np++;
     const ramfs_entry_t* e = ramfs_find(np);
@@ -0,0 +1,75 @@
+/*
+ * SecOS Kernel - Boot phase timing
+ * Copyright (c) 2025 iDev srl
+ * Author: Luigi De Astis <l.deastis@idev-srl.com>
+ * SPDX-License-Identifier: MIT
+ */
+#include "boottime.h"
+#include "timer.h"
+#include "pmm.h"
+#include "terminal.h"
+
+typedef struct boot_phase {
+    const char* name;
+    uint64_t cycles;
+} boot_phase_t;
+
+static boot_phase_t phases[BOOT_MAX_PHASES];
+static int phase_count = 0;
+static uint64_t tsc_start = 0;  // kernel_main entry
+static uint64_t tsc_last = 0;   // end of the previous phase
+
+void boot_phase_start(void) {
+    tsc_start = tsc_last = timer_rdtsc();
+    phase_count = 0;
+}
+
+void boot_phase_end(const char* name) {
+    uint64_t now = timer_rdtsc();
+    if (phase_count < BOOT_MAX_PHASES) {
+        phases[phase_count].name = name;
+        phases[phase_count].cycles = now - tsc_last;
+        phase_count++;
+    }
+    tsc_last = now;
+}
+
+static void print_u64(uint64_t v) {
+    char buf[24]; int i = 0;
+    if (v == 0) buf[i++] = '0';
+    while (v) { buf[i++] = (char)('0' + v % 10); v /= 10; }
+    while (i) terminal_putchar(buf[--i]);
+}
+
+// "<cycles> cycles (<us> us)", microseconds only once the TSC is calibrated
+static void print_cycles(uint64_t cycles, uint64_t khz) {
+    print_u64(cycles); terminal_writestring(" cycles");
+    if (khz) { terminal_writestring(" ("); print_u64(cycles * 1000 / khz); terminal_writestring(" us)"); }
+}
+
+void boot_print_phases(void) {
+    uint64_t khz = timer_tsc_khz();
+    terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_CYAN, VGA_COLOR_BLACK));
+    terminal_writestring("[BOOT] phase timing");
+    if (khz) { terminal_writestring(", TSC "); print_u64(khz / 1000); terminal_writestring(" MHz"); }
+    terminal_writestring("\n");
+    terminal_setcolor(vga_entry_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK));
+    for (int i = 0; i < phase_count; i++) {
+        terminal_writestring("  "); terminal_writestring(phases[i].name);
+        terminal_writestring(": "); print_cycles(phases[i].cycles, khz); terminal_writestring("\n");
+    }
+    terminal_writestring("  total: "); print_cycles(tsc_last - tsc_start, khz); terminal_writestring("\n");
+    pmm_deferred_stats_t d; pmm_get_deferred_stats(&d);
+    terminal_writestring("  highmem init: "); print_cycles(d.init_cycles, khz);
+    if (d.pending_sections) {
+        terminal_writestring(", pending "); print_u64(d.pending_sections);
+        terminal_writestring(" sections ("); print_u64(d.pending_frames * PMM_FRAME_SIZE / 1024 / 1024); terminal_writestring(" MB)");
+    } else if (d.done_tsc > tsc_last) {
+        terminal_writestring(", done "); print_cycles(d.done_tsc - tsc_last, khz); terminal_writestring(" after boot");
+    } else if (d.done_tsc) {
+        terminal_writestring(", done during boot");
+    }
+    terminal_writestring(" lazy="); print_u64(d.lazy_inits);
+    terminal_writestring(" idle="); print_u64(d.idle_inits);
+    terminal_writestring("\n");
+}
@@ -0,0 +1,19 @@
+#ifndef BOOTTIME_H
+#define BOOTTIME_H
+/*
+ * SecOS Kernel - Boot phase timing
+ * Copyright (c) 2025 iDev srl
+ * Author: Luigi De Astis <l.deastis@idev-srl.com>
+ * SPDX-License-Identifier: MIT
+ */
+#include <stdint.h>
+
+#define BOOT_MAX_PHASES 16
+
+// TSC stamps taken by kernel_main between init steps. The TSC frequency is only known
+// once the PIT runs, so durations are kept in cycles and converted when printed.
+void boot_phase_start(void);            // kernel_main entry
+void boot_phase_end(const char* name);  // closes the phase running since the previous mark
+void boot_print_phases(void);           // per-phase report (+ deferred PMM init), boottime command
+
+#endif
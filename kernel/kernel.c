@@ -37,6 +37,7 @@
 #include "shell.h"
 #include "sched.h"
 #include "panic.h"
+#include "boottime.h"
 #include "driver_if.h" // driver registry init
 #if ENABLE_FB
 #include "fb.h"
@@ -56,6 +57,7 @@ static void print_banner(void) {
 
 void kernel_main(uint32_t multiboot_magic, uint64_t multiboot_info) {
     // Kernel start
+    boot_phase_start();
     terminal_initialize();
     // Print startup banner
     void print_banner(void);
@@ -83,11 +85,16 @@ void kernel_main(uint32_t multiboot_magic, uint64_t multiboot_info) {
     } else {
     pmm_init((void*)multiboot_info);
     }
+    boot_phase_end("pmm (low memory)");
     // pmm_print_stats(); // optional
     vmm_init();
     // terminal_writestring("[OK] IDT initialization...\n");
     idt_init();
     vmm_init_physmap();
+    vmm_init_pcid(); // global kernel mappings + PCID-tagged user spaces
+    boot_phase_end("vmm + idt + physmap");
+    pmm_init_highmem(); // memory above the identity map, reached through the physmap
+    boot_phase_end("pmm (high memory)");
     tss_init();
 
     // Debug addresses (enable if needed)
@@ -103,12 +110,15 @@ void kernel_main(uint32_t multiboot_magic, uint64_t multiboot_info) {
 
     heap_init();
     sched_init();
+    sched_register_idle_callback(pmm_deferred_init_idle); // remaining RAM sections
+    sched_register_idle_callback(pmm_zero_pool_idle); // background frame zeroing
     // Initialize driver space device registry (required for drvreg)
     driver_registry_init();
     // terminal_writestring("[OK] PIT timer initialization (1000 Hz)...\n");
     timer_init(1000);
     // terminal_writestring("[OK] PS/2 keyboard initialization...\n");
     keyboard_init();
+    boot_phase_end("tss + heap + sched + timer + kbd");
 
     // Initialize native RAMFS (fallback)
     extern int ramfs_init(void); ramfs_init();
@@ -148,6 +158,7 @@ void kernel_main(uint32_t multiboot_magic, uint64_t multiboot_info) {
     } else {
         terminal_writestring("[INIT] init.rc not found\n");
     }
+    boot_phase_end("fs + init.rc");
 
 #if ENABLE_FB
     if (multiboot_magic == MULTIBOOT2_BOOTLOADER_MAGIC) {
@@ -171,7 +182,12 @@ void kernel_main(uint32_t multiboot_magic, uint64_t multiboot_info) {
         }
     }
 #endif
+    // Last identity-map user (multiboot info for fb_init) is done: page tables, IST stacks
+    // and frames are all reached through the physmap from here on
+    vmm_trim_identity_map();
 
+    boot_phase_end("framebuffer");
+    boot_print_phases();
     // terminal_writestring("[OK] Sistema pronto!\n");
     shell_init();
 #if ENABLE_FB
@@ -11,14 +11,26 @@
 #include "panic.h"
 #include "mm/elf_manifest.h"
 #include "pmm.h"
+#include "timer.h"
 
 #define MAX_PROCESSES 32
 static process_t* proc_table[MAX_PROCESSES];
 static uint32_t next_pid = 1;
 static int proc_inited = 0;
+// Cache dedicate: il churn dei processi non frammenta l'heap generico
+static kmem_cache_t* proc_cache = NULL;
+static kmem_cache_t* manifest_cache = NULL;
+
+// Costruttore: fd table vuota (process_destroy la riporta in questo stato)
+static void proc_ctor(void* obj) {
+    process_t* p = (process_t*)obj;
+    for(int i=0;i<32;i++){ p->fds[i].inode=NULL; p->fds[i].offset=0; p->fds[i].flags=0; p->fds[i].used=0; }
+}
 
 int process_init_system(void) {
     for (int i=0;i<MAX_PROCESSES;i++) proc_table[i]=0;
+    if (!proc_cache) proc_cache = kmem_cache_create("process", sizeof(process_t), 64, proc_ctor);
+    if (!manifest_cache) manifest_cache = kmem_cache_create("elf_manifest", sizeof(elf_manifest_t), 8, NULL);
     proc_inited = 1;
     terminal_writestring("[PROC] process table initialized\n");
     return 0;
@@ -60,17 +72,21 @@ void process_foreach(void (*cb)(process_t*, void*), void* user) {
     }
 }
 
-process_t* process_create_from_elf(const void* elf_buf, size_t size) {
-    if (!proc_inited) process_init_system();
+static process_t* process_create(const void* elf_buf, size_t size) {
     vmm_space_t* space = vmm_space_create_user();
     if (!space) { terminal_writestring("[PROC] space alloc failed\n"); return NULL; }
     uint64_t entry=0;
-    uint64_t* pages=NULL; uint32_t page_count=0;
-    int r = elf_load_image(elf_buf, size, space, &entry, &pages, &page_count);
-    if (r != ELF_OK) { terminal_writestring("[PROC] elf load fail\n"); return NULL; }
+    uint32_t page_count=0;
+    // Manifest letto prima del caricamento: colour_mask deve valere gia' per le pagine ELF
+    elf_manifest_t* mf = (elf_manifest_t*)kmem_cache_alloc(manifest_cache);
+    int mf_ok = (mf && elf_manifest_parse(elf_buf, size, mf) == 0);
+    if (mf_ok) space->colour_mask = mf->colour_mask;
+    int r = elf_load_image(elf_buf, size, space, &entry, &page_count);
+    // Errori: vmm_space_destroy libera anche i segmenti gia' mappati, le tabelle e la PML4
+    if (r != ELF_OK) { terminal_writestring("[PROC] elf load fail\n"); if (mf) kmem_cache_free(manifest_cache, mf); vmm_space_destroy(space); return NULL; }
     uint64_t st_top = vmm_alloc_user_stack_in_space(space, 8);
-    process_t* p = (process_t*)kmalloc(sizeof(process_t));
-    if (!p) return NULL;
+    process_t* p = (process_t*)kmem_cache_alloc(proc_cache);
+    if (!p) { if (mf) kmem_cache_free(manifest_cache, mf); vmm_space_destroy(space); return NULL; }
     p->pid = next_pid++;
     p->space = space;
     p->entry = entry;
@@ -78,33 +94,15 @@ process_t* process_create_from_elf(const void* elf_buf, size_t size) {
     p->kstack_top = 0; // da allocare quando introdurremo scheduler/trap
     p->state = PROC_NEW;
     p->manifest = NULL;
-    // Tracking pagine: aggiungi pagine stack (eccetto guard) se pages!=NULL
-    p->mapped_pages = pages;
-    p->mapped_page_count = page_count;
+    // Footprint virtuale: segmenti ELF + 8 pagine stack (VMA, fault al primo accesso; guard esclusa).
+    // Nessuna lista di pagine: l'unload percorre le tabelle (vmm_unmap_user).
+    p->mapped_page_count = page_count + 8;
     p->cpu_ticks = 0;
-    p->user_mem_bytes = (uint64_t)page_count * 4096ULL; // aggiornato dopo eventuale aggiunta stack
-    if (pages) {
-        // Pagine stack utente: N=8 mappate + 1 guard (non tracciare guard)
-        uint32_t stack_user_pages = 8 - 1; // exclude guard
-        uint64_t* newarr = (uint64_t*)kmalloc(sizeof(uint64_t)*(p->mapped_page_count + stack_user_pages));
-        if (newarr) {
-            for (uint32_t i=0;i<p->mapped_page_count;i++) newarr[i]=p->mapped_pages[i];
-            uint32_t idx = p->mapped_page_count;
-            uint64_t first = st_top - (8*0x1000ULL);
-            for (uint64_t va = first + 0x1000ULL; va < st_top; va += 0x1000ULL) {
-                newarr[idx++] = va;
-            }
-            kfree(p->mapped_pages);
-            p->mapped_pages = newarr;
-            p->mapped_page_count = idx;
-            p->user_mem_bytes = (uint64_t)p->mapped_page_count * 4096ULL;
-        } else {
-            terminal_writestring("[PROC] stack pages alloc fail\n");
-        }
-    }
-    // Manifest stub
-    elf_manifest_t* mf = (elf_manifest_t*)kmalloc(sizeof(elf_manifest_t));
-    if (mf && elf_manifest_parse(elf_buf, size, mf) == 0) {
+    p->user_mem_bytes = (uint64_t)p->mapped_page_count * 4096ULL;
+    // Tag user frames with the owner pid (struct page owner, for diagnostics / sharing)
+    vmm_space_resident(space, (uint32_t)p->pid);
+    // Manifest (parsato sopra)
+    if (mf_ok) {
         // Validazione entry e flags
         if (elf_manifest_validate(mf, entry) == MANIFEST_OK) {
             // Enforce max_mem se valorizzato
@@ -112,28 +110,28 @@ process_t* process_create_from_elf(const void* elf_buf, size_t size) {
                 uint64_t used_mem = (uint64_t)p->mapped_page_count * 4096ULL;
                 if (used_mem > mf->max_mem) {
                     terminal_writestring("[MANIFEST] max_mem superato, abort processo\n");
-                    kfree(mf);
+                    kmem_cache_free(manifest_cache, mf);
                     // Cleanup parziale
                     elf_unload_process(p);
-                    pmm_free_frame((void*)(space->pml4_phys & 0x000FFFFFFFFFF000ULL));
-                    kfree(space);
-                    kfree(p);
+                    vmm_space_destroy(space); // tabelle, frame e PML4
+                    kmem_cache_free(proc_cache, p);
                     return NULL;
                 }
             }
             p->manifest = mf;
         } else {
             terminal_writestring("[MANIFEST] validation fail, scarto manifest\n");
-            kfree(mf);
+            kmem_cache_free(manifest_cache, mf);
         }
+    } else if (mf) {
+        kmem_cache_free(manifest_cache, mf);
     }
     p->regs.rip = entry;
     p->regs.rsp = st_top;
     p->regs.rflags = 0x202; // IF abilitato default
     p->regs.rax = p->regs.rbx = p->regs.rcx = p->regs.rdx = 0;
     p->regs.rsi = p->regs.rdi = p->regs.rbp = 0;
-    // Init fd table
-    for(int i=0;i<32;i++){ p->fds[i].inode=NULL; p->fds[i].offset=0; p->fds[i].flags=0; p->fds[i].used=0; }
+    // fd table gia' vuota (proc_ctor)
     if (proc_add(p)!=0) { terminal_writestring("[PROC] table full\n"); }
     // Hardening mapping condiviso
     vmm_harden_user_space(space);
@@ -145,6 +143,60 @@ process_t* process_create_from_elf(const void* elf_buf, size_t size) {
     return p;
 }
 
+process_t* process_create_from_elf(const void* elf_buf, size_t size) {
+    if (!proc_inited) process_init_system();
+    // heapprof: allocazioni attribuite al PID nascente; se la creazione fallisce quello
+    // che resta allocato e' gia' un leak
+    uint32_t pid = next_pid;
+    uint32_t prev_owner = heap_prof_set_owner(pid);
+    process_t* p = process_create(elf_buf, size);
+    heap_prof_set_owner(prev_owner);
+    if (!p) heap_prof_owner_exit(pid);
+    return p;
+}
+
+// Fork: il figlio condivide le pagine utente del padre in copy-on-write (vmm_clone_space).
+// Si duplicano solo tabelle delle pagine, VMA, manifest e fd table: il costo e'
+// O(tabelle) e non dipende dalla memoria scritta dal padre.
+static process_t* process_clone(process_t* parent) {
+    vmm_space_t* space = vmm_clone_space(parent->space);
+    if (!space) { terminal_writestring("[PROC] clone space failed\n"); return NULL; }
+    process_t* p = (process_t*)kmem_cache_alloc(proc_cache);
+    if (!p) { vmm_space_destroy(space); return NULL; }
+    p->pid = next_pid++;
+    p->space = space;
+    p->entry = parent->entry;
+    p->stack_top = parent->stack_top;
+    p->kstack_top = 0;
+    p->state = PROC_NEW;
+    p->regs = parent->regs;
+    p->manifest = NULL;
+    p->mapped_page_count = parent->mapped_page_count;
+    p->cpu_ticks = 0;
+    p->user_mem_bytes = parent->user_mem_bytes;
+    if (parent->manifest) {
+        elf_manifest_t* mf = (elf_manifest_t*)kmem_cache_alloc(manifest_cache);
+        if (mf) { *mf = *(elf_manifest_t*)parent->manifest; p->manifest = mf; }
+    }
+    for (int i=0;i<32;i++) p->fds[i] = parent->fds[i];
+    if (proc_add(p)!=0) { terminal_writestring("[PROC] table full\n"); }
+    return p;
+}
+
+process_t* process_fork(process_t* parent) {
+    if (!parent || !parent->space) return NULL;
+    uint32_t pid = next_pid;
+    uint32_t prev_owner = heap_prof_set_owner(pid);
+    process_t* p = process_clone(parent);
+    heap_prof_set_owner(prev_owner);
+    if (!p) { heap_prof_owner_exit(pid); return NULL; }
+    terminal_writestring("[PROC] fork PID=");
+    char hx[]="0123456789ABCDEF"; for(int i=28;i>=0;i-=4) terminal_putchar(hx[(parent->pid>>i)&0xF]);
+    terminal_writestring(" -> PID="); for(int i=28;i>=0;i-=4) terminal_putchar(hx[(p->pid>>i)&0xF]);
+    terminal_writestring(" (COW)\n");
+    return p;
+}
+
 void process_print(const process_t* p) {
     if (!p) return;
     terminal_writestring("[PROC] PID=");
@@ -155,18 +207,39 @@ void process_print(const process_t* p) {
     terminal_writestring("\n");
 }
 
+static proc_kill_stats_t last_kill;
+static int last_kill_valid = 0;
+
+const proc_kill_stats_t* process_last_kill(void) {
+    return last_kill_valid ? &last_kill : NULL;
+}
+
 int process_destroy(process_t* p) {
     if (!p) return -1;
-    extern int elf_unload_process(process_t* p);
-    elf_unload_process(p);
-    if (p->manifest) kfree(p->manifest);
-    if (p->mapped_pages) { kfree(p->mapped_pages); p->mapped_pages=NULL; }
+    // Costo del teardown misurato in cicli TSC (ps/pinfo: "last kill"): solo la discesa
+    // unica nelle tabelle e la distruzione dello spazio, il log [ELFUNLOAD] viene dopo t1
+    uint64_t resident = p->space ? vmm_space_resident(p->space, 0) : 0;
+    uint64_t unmapped = 0;
+    int had_space = (p->space != NULL);
+    uint64_t t0 = timer_rdtsc();
     if (p->space) {
-        pmm_free_frame((void*)(p->space->pml4_phys & 0x000FFFFFFFFFF000ULL));
-        kfree(p->space);
+        unmapped = vmm_unmap_user(p->space);
+        vmm_space_destroy(p->space); // tabelle rimaste, VMA e PML4
+        p->space = NULL;
     }
+    uint64_t t1 = timer_rdtsc();
+    if (had_space) elf_unload_report(p, unmapped);
+    last_kill.pid = p->pid;
+    last_kill.pages = resident;
+    last_kill.cycles = t1 - t0;
+    last_kill_valid = 1;
+    if (p->manifest) kmem_cache_free(manifest_cache, p->manifest);
     proc_remove(p);
-    kfree(p);
+    // Oggetto torna alla cache nello stato costruito: chiudi fd rimasti aperti
+    for(int i=0;i<32;i++){ if (p->fds[i].used) { p->fds[i].inode=NULL; p->fds[i].offset=0; p->fds[i].flags=0; p->fds[i].used=0; } }
+    uint32_t pid = p->pid;
+    kmem_cache_free(proc_cache, p);
+    heap_prof_owner_exit(pid); // heapprof: cio' che resta del PID e' un leak
     terminal_writestring("[PROC] distrutto\n");
     return 0;
 }
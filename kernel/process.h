@@ -25,8 +25,7 @@ typedef struct process {
         uint64_t rbp;
     } regs;
     void* manifest; // stub pointer to future manifest_t
-    uint64_t* mapped_pages; // array of virtual page addresses (code+data+stack)
-    uint32_t mapped_page_count; // page count
+    uint32_t mapped_page_count; // virtual pages (ELF segments + stack), resident or lazy
     // Runtime metrics
     uint64_t cpu_ticks;      // accumulated CPU ticks (scheduler)
     uint64_t user_mem_bytes; // virtual memory footprint (updated at creation / future extensions)
@@ -36,10 +35,19 @@ typedef struct process {
 
 int process_init_system(void); // initialize process table
 process_t* process_create_from_elf(const void* elf_buf, size_t size);
+process_t* process_fork(process_t* parent); // copy-on-write child (shares user pages)
 void process_print(const process_t* p);
 process_t* process_get_last(void);
 process_t* process_find_by_pid(uint32_t pid);
 void process_foreach(void (*cb)(process_t*, void*), void* user);
 int process_destroy(process_t* p);
 
+// Cost of the last process_destroy (user teardown + space destroy), for ps/pinfo
+typedef struct proc_kill_stats {
+    uint32_t pid;
+    uint64_t pages;  // resident user pages released
+    uint64_t cycles; // TSC cycles
+} proc_kill_stats_t;
+const proc_kill_stats_t* process_last_kill(void); // NULL before the first kill
+
 #endif // PROCESS_H
@@ -53,3 +53,20 @@ void sched_on_timer_tick(void) {
     // For now yield every tick (future: quantum)
     sched_yield();
 }
+
+// Idle callbacks (background work such as PMM frame zeroing). Each callback must do a
+// bounded amount of work: the keyboard and timer wait loops call sched_idle() once per wakeup.
+#define MAX_IDLE_CBS 4
+static sched_idle_cb_t idle_cbs[MAX_IDLE_CBS];
+static int idle_cb_count = 0;
+
+int sched_register_idle_callback(sched_idle_cb_t cb) {
+    if (idle_cb_count >= MAX_IDLE_CBS) return -1;
+    idle_cbs[idle_cb_count++] = cb;
+    return 0;
+}
+
+void sched_idle(void) {
+    for (int i = 0; i < idle_cb_count; i++) idle_cbs[i]();
+    __asm__ volatile ("hlt");  // Wait for interrupt
+}
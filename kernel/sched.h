@@ -8,4 +8,9 @@ process_t* sched_get_current(void);
 int sched_add_process(process_t* p); // opzionale (wrapper)
 void sched_yield(void); // invocare per switch cooperativo (stub)
 
+// Idle work: callbacks run whenever the CPU would otherwise wait in hlt
+typedef void (*sched_idle_cb_t)(void);
+int sched_register_idle_callback(sched_idle_cb_t cb);
+void sched_idle(void); // run idle callbacks, then hlt until the next interrupt
+
 #endif
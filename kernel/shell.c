@@ -20,6 +20,7 @@
 #include "fs/ramfs.h" // RAMFS API
 #include "fs/vfs.h" // VFS API
 #include "driver_if.h" // driver space API
+#include "boottime.h" // boot phase timing
 #include <stdint.h>
 #include <stddef.h>
 
@@ -95,16 +96,23 @@ static void sh_echo(const char* a);
 static void sh_info(const char* a);
 static void sh_fontdump(const char* a);
 static void sh_uptime(const char* a);
+static void sh_boottime(const char* a);
 static void sh_sleep(const char* a);
 static void sh_mem(const char* a);
 static void sh_memtest(const char* a);
 static void sh_memstress(const char* a);
+static void sh_heapprof(const char* a);
+static void sh_pmminfo(const char* a);
+static void sh_pmmbench(const char* a);
+static void sh_vmmbench(const char* a);
+static void sh_colourbench(const char* a);
 static void sh_usertest(const char* a);
 static void sh_elfload(const char* a);
 static void sh_elfload2(const char* a);
 static void sh_elfunload(const char* a);
 static void sh_ps(const char* a);
 static void sh_kill(const char* a);
+static void sh_spawn(const char* a);
 static void sh_crash(const char* a);
 static void sh_colors(const char* a);
 static void sh_fbinfo(const char* a);
@@ -167,15 +175,22 @@ static const struct shell_cmd shell_cmds[] = {
     {"echo",      sh_echo},
     {"info",      sh_info},
     {"uptime",    sh_uptime},
+    {"boottime",  sh_boottime},
     {"sleep",     sh_sleep},
     {"mem",       sh_mem},
     {"memtest",   sh_memtest},
     {"memstress", sh_memstress},
+    {"heapprof",  sh_heapprof},
+    {"pmminfo",   sh_pmminfo},
+    {"pmmbench",  sh_pmmbench},
+    {"vmmbench",  sh_vmmbench},
+    {"colourbench", sh_colourbench},
     {"usertest",  sh_usertest},
     {"elfload",   sh_elfload},
     {"elfload2",  sh_elfload2},
     {"elfunload", sh_elfunload},
     {"kill",      sh_kill},
+    {"spawn",     sh_spawn},
     {"pinfo",     sh_pinfo},
     {"ps",        sh_ps},
     {"crash",     sh_crash},
@@ -236,8 +251,8 @@ static void shell_print_help_paged(void){
         pager_print("RAMFS: rfls rfcat rfinfo rfadd rfwrite rfdel rfmkdir rfrmdir rfcd rfpwd rftree rfusage rfmv rftruncate");
         pager_print("VFS: vls vcat vinfo vpwd vmount vcreate vwrite vtruncate");
         pager_print("Drivers: drvinfo drvreg drvunreg drvlog drvtest");
-        pager_print("System: help clear info uptime sleep mem memtest memstress colors color fbinfo fontdump halt reboot crash");
-        pager_print("Other: elfload elfload2 elfunload ps pinfo kill ext2mount usertest logo date (if enabled)");
+        pager_print("System: help clear info uptime boottime sleep mem memtest memstress heapprof pmminfo pmmbench vmmbench colourbench colors color fbinfo fontdump halt reboot crash");
+        pager_print("Other: elfload elfload2 elfunload ps pinfo kill spawn ext2mount usertest logo date (if enabled)");
         pager_print("");
         pager_print("Use 'pager off' to disable paging or 'pager lines N' to change page size.");
     }
@@ -463,7 +478,30 @@ static void cmd_crash(const char* args) {
     }
 }
 
-// Stress test heap: perform many allocations to test expansion and coalescing
+// memstress latency samples (static: too large for the shell stack)
+#define MEMSTRESS_LAT_SAMPLES 512
+static void* ms_ptrs[MEMSTRESS_LAT_SAMPLES];
+static uint64_t ms_alloc_cycles[MEMSTRESS_LAT_SAMPLES];
+static uint64_t ms_free_cycles[MEMSTRESS_LAT_SAMPLES];
+
+// Sort the samples in place and print p50/p90/p99/max
+static void memstress_print_percentiles(const char* label, uint64_t* v, uint64_t n) {
+    for (uint64_t i = 1; i < n; i++) {
+        uint64_t x = v[i], j = i;
+        while (j > 0 && v[j - 1] > x) { v[j] = v[j - 1]; j--; }
+        v[j] = x;
+    }
+    char buf[32];
+    terminal_writestring(label);
+    terminal_writestring(" p50="); itoa(v[n * 50 / 100], buf, 10); terminal_writestring(buf);
+    terminal_writestring(" p90="); itoa(v[n * 90 / 100], buf, 10); terminal_writestring(buf);
+    terminal_writestring(" p99="); itoa(v[n * 99 / 100], buf, 10); terminal_writestring(buf);
+    terminal_writestring(" max="); itoa(v[n - 1], buf, 10); terminal_writestring(buf);
+    terminal_writestring("\n");
+}
+
+// Stress test heap: perform many allocations to test expansion and coalescing, then
+// measure kmalloc/kfree latency percentiles on the arena path
 static void cmd_memstress(void) {
     terminal_setcolor(vga_entry_color(VGA_COLOR_YELLOW, VGA_COLOR_BLACK));
     terminal_writestring("\nStarting memstress (repeated allocations)...\n");
@@ -527,12 +565,216 @@ static void cmd_memstress(void) {
     for (int i=0; i<big_count; i++) kfree(big_ptrs[i]);
     terminal_writestring("[memstress] Freed all blocks\n");
 
+    // Latency of the arena path (sizes between the largest slab class and a page):
+    // allocate a batch, free it in shuffled order so neighbours merge from both sides
+    const uint64_t lat_count = MEMSTRESS_LAT_SAMPLES;
+    uint32_t seed = 12345;
+    for (uint64_t i = 0; i < lat_count; i++) {
+        seed = seed * 1103515245u + 12345u;
+        size_t sz = 2049 + (seed >> 8) % 2000;
+        uint64_t t0 = timer_rdtsc();
+        ms_ptrs[i] = kmalloc(sz);
+        ms_alloc_cycles[i] = timer_rdtsc() - t0;
+    }
+    for (uint64_t i = lat_count - 1; i > 0; i--) {
+        seed = seed * 1103515245u + 12345u;
+        uint64_t j = (seed >> 8) % (i + 1);
+        void* t = ms_ptrs[i]; ms_ptrs[i] = ms_ptrs[j]; ms_ptrs[j] = t;
+    }
+    for (uint64_t i = 0; i < lat_count; i++) {
+        uint64_t t0 = timer_rdtsc();
+        kfree(ms_ptrs[i]);
+        ms_free_cycles[i] = timer_rdtsc() - t0;
+    }
+    memstress_print_percentiles("[memstress] kmalloc cycles:", ms_alloc_cycles, lat_count);
+    memstress_print_percentiles("[memstress] kfree cycles:  ", ms_free_cycles, lat_count);
+
     heap_print_stats();
     terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_GREEN, VGA_COLOR_BLACK));
     terminal_writestring("[memstress] Completed\n");
     terminal_setcolor(vga_entry_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK));
 }
 
+// PMM microbenchmark: average TSC cycles per operation (pmmbench [frames], max 4096)
+#define PMMBENCH_MAX 4096
+static void pmmbench_report(const char* label, uint64_t cycles, int ops) {
+    char buf[32];
+    terminal_writestring(label);
+    itoa(ops ? cycles / (uint64_t)ops : 0, buf, 10);
+    terminal_writestring(buf);
+    terminal_writestring(" cycles/op (");
+    itoa(ops, buf, 10);
+    terminal_writestring(buf);
+    terminal_writestring(" ops)\n");
+}
+
+static void cmd_pmmbench(const char* args) {
+    static void* frames[PMMBENCH_MAX];
+    while (args && *args == ' ') args++;
+    int n = (args && *args) ? (int)atoi(args) : 1024;
+    if (n <= 0 || n > PMMBENCH_MAX) n = PMMBENCH_MAX;
+    terminal_setcolor(vga_entry_color(VGA_COLOR_YELLOW, VGA_COLOR_BLACK));
+#if PMM_USE_BUDDY
+    terminal_writestring("\n[pmmbench] allocator: buddy\n");
+#else
+    terminal_writestring("\n[pmmbench] allocator: summary bitmap\n");
+#endif
+    terminal_setcolor(vga_entry_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK));
+
+    // Interrupts off: timer/keyboard IRQs would otherwise land inside the measured loops
+    __asm__ volatile ("cli");
+    int got = 0;
+    uint64_t t0 = timer_rdtsc();
+    for (; got < n; got++) { frames[got] = pmm_alloc_frame(); if (!frames[got]) break; }
+    uint64_t t1 = timer_rdtsc();
+    for (int i = 0; i < got; i++) pmm_free_frame(frames[i]);
+    uint64_t t2 = timer_rdtsc();
+    for (int i = 0; i < n; i++) { void* f = pmm_alloc_frame(); if (f) pmm_free_frame(f); }
+    uint64_t t3 = timer_rdtsc();
+    int got16 = 0;
+    for (; got16 < n / 16; got16++) { frames[got16] = pmm_alloc_frames(16, 0); if (!frames[got16]) break; }
+    uint64_t t4 = timer_rdtsc();
+    for (int i = 0; i < got16; i++) pmm_free_frames(frames[i], 16);
+    uint64_t t5 = timer_rdtsc();
+    __asm__ volatile ("sti");
+
+    pmmbench_report("  alloc 1 frame:      ", t1 - t0, got);
+    pmmbench_report("  free 1 frame:       ", t2 - t1, got);
+    pmmbench_report("  alloc+free pair:    ", t3 - t2, n);
+    pmmbench_report("  alloc 16 contiguous:", t4 - t3, got16);
+    pmmbench_report("  free 16 contiguous: ", t5 - t4, got16);
+}
+
+// Page-table benchmark: map and unmap [MB] (default 64, max 256) in a scratch user space,
+// page by page (vmm_map_in_space) and as one range (vmm_map_range). Every 2MB window maps
+// the first 2MB of RAM, which the PMM never hands out, so no frames are allocated or
+// freed and only the table walks are measured. Tables stay in the scratch space between runs.
+#define VMMBENCH_MAX_MB 256
+static void cmd_vmmbench(const char* args) {
+    static vmm_space_t* bench_space = NULL;
+    while (args && *args == ' ') args++;
+    int mb = (args && *args) ? (int)atoi(args) : 64;
+    if (mb <= 0 || mb > VMMBENCH_MAX_MB) mb = VMMBENCH_MAX_MB;
+    mb &= ~1; if (!mb) mb = 2;
+    if (!bench_space) bench_space = vmm_space_create_user();
+    if (!bench_space) { terminal_writestring("vmmbench: no space\n"); return; }
+    const uint64_t base = USER_DATA_BASE;
+    const uint64_t win = 2ULL * 1024 * 1024;
+    uint64_t pages = (uint64_t)mb * 256;
+    uint64_t flags = VMM_FLAG_USER | VMM_FLAG_RW | VMM_FLAG_NOEXEC;
+    terminal_setcolor(vga_entry_color(VGA_COLOR_YELLOW, VGA_COLOR_BLACK));
+    terminal_writestring("\n[vmmbench] pages: "); { char b[32]; itoa(pages, b, 10); terminal_writestring(b); } terminal_writestring("\n");
+    terminal_setcolor(vga_entry_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK));
+
+    // Warm-up creates the page tables so both variants find them in place
+    for (uint64_t off = 0; off < pages * 4096; off += win) vmm_map_range(bench_space, base + off, 0, 512, flags);
+    vmm_unmap_range(bench_space, base, pages);
+
+    __asm__ volatile ("cli");
+    uint64_t t0 = timer_rdtsc();
+    for (uint64_t i = 0; i < pages; i++) vmm_map_in_space(bench_space, base + i * 4096, (i % 512) * 4096, flags);
+    uint64_t t1 = timer_rdtsc();
+    for (uint64_t i = 0; i < pages; i++) vmm_unmap_in_space(bench_space, base + i * 4096);
+    uint64_t t2 = timer_rdtsc();
+    for (uint64_t off = 0; off < pages * 4096; off += win) vmm_map_range(bench_space, base + off, 0, 512, flags);
+    uint64_t t3 = timer_rdtsc();
+    vmm_unmap_range(bench_space, base, pages);
+    uint64_t t4 = timer_rdtsc();
+    __asm__ volatile ("sti");
+
+    pmmbench_report("  map per page:   ", t1 - t0, (int)pages);
+    pmmbench_report("  unmap per page: ", t2 - t1, (int)pages);
+    pmmbench_report("  map range:      ", t3 - t2, (int)pages);
+    pmmbench_report("  unmap range:    ", t4 - t3, (int)pages);
+}
+
+// Page colouring benchmark: latency jitter of a "control loop" pass over its working set
+// after a background buffer has streamed through the LLC. Run once with frames placed by
+// the plain allocator and once with control and background confined to disjoint colours.
+// colourbench [iterations], max 256. Meaningful on KVM / real hardware (TCG has no LLC model).
+#if PMM_COLOURS
+#define CB_CTRL_PAGES 64     // 256KB control working set
+#define CB_BG_PAGES   1024   // 4MB background stream
+#define CB_MAX_ITERS  256
+static void* cb_ctrl[CB_CTRL_PAGES];
+static void* cb_bg[CB_BG_PAGES];
+static uint64_t cb_samples[CB_MAX_ITERS];
+
+static uint64_t isqrt64(uint64_t v) {
+    uint64_t r = 0, bit = 1ULL << 62;
+    while (bit > v) bit >>= 2;
+    while (bit) {
+        if (v >= r + bit) { v -= r + bit; r = (r >> 1) + bit; } else r >>= 1;
+        bit >>= 2;
+    }
+    return r;
+}
+
+static void colourbench_run(const char* label, uint64_t ctrl_mask, uint64_t bg_mask, int iters) {
+    char buf[32];
+    int nc = 0, nb = 0;
+    for (; nc < CB_CTRL_PAGES; nc++) { cb_ctrl[nc] = ctrl_mask ? pmm_alloc_coloured_frame(ctrl_mask) : pmm_alloc_frame(); if (!cb_ctrl[nc]) break; }
+    for (; nb < CB_BG_PAGES; nb++) { cb_bg[nb] = bg_mask ? pmm_alloc_coloured_frame(bg_mask) : pmm_alloc_frame(); if (!cb_bg[nb]) break; }
+    if (nc < CB_CTRL_PAGES || nb < CB_BG_PAGES) {
+        terminal_writestring("[colourbench] out of memory\n");
+    } else {
+        __asm__ volatile ("cli");
+        for (int it = 0; it < iters; it++) {
+            // Background: write every cache line of the stream
+            for (int i = 0; i < nb; i++) {
+                volatile uint64_t* q = (volatile uint64_t*)phys_to_virt((uint64_t)cb_bg[i]);
+                for (int l = 0; l < 4096 / 8; l += 8) q[l] = (uint64_t)it;
+            }
+            // Control loop: read its working set, timed
+            uint64_t sum = 0;
+            uint64_t t0 = timer_rdtsc();
+            for (int i = 0; i < nc; i++) {
+                volatile uint64_t* q = (volatile uint64_t*)phys_to_virt((uint64_t)cb_ctrl[i]);
+                for (int l = 0; l < 4096 / 8; l += 8) sum += q[l];
+            }
+            cb_samples[it] = timer_rdtsc() - t0;
+            (void)sum;
+        }
+        __asm__ volatile ("sti");
+        uint64_t min = ~0ULL, max = 0, total = 0, var = 0;
+        for (int it = 0; it < iters; it++) {
+            uint64_t v = cb_samples[it];
+            total += v; if (v < min) min = v; if (v > max) max = v;
+        }
+        uint64_t mean = total / (uint64_t)iters;
+        for (int it = 0; it < iters; it++) {
+            uint64_t d = cb_samples[it] > mean ? cb_samples[it] - mean : mean - cb_samples[it];
+            var += d * d;
+        }
+        var /= (uint64_t)iters;
+        terminal_writestring(label);
+        terminal_writestring(" mean="); itoa(mean, buf, 10); terminal_writestring(buf);
+        terminal_writestring(" stddev="); itoa(isqrt64(var), buf, 10); terminal_writestring(buf);
+        terminal_writestring(" min="); itoa(min, buf, 10); terminal_writestring(buf);
+        terminal_writestring(" max="); itoa(max, buf, 10); terminal_writestring(buf);
+        terminal_writestring(" cycles\n");
+    }
+    for (int i = 0; i < nc; i++) pmm_free_frame(cb_ctrl[i]);
+    for (int i = 0; i < nb; i++) pmm_free_frame(cb_bg[i]);
+}
+#endif // PMM_COLOURS
+
+static void cmd_colourbench(const char* args) {
+#if PMM_COLOURS
+    while (args && *args == ' ') args++;
+    int iters = (args && *args) ? (int)atoi(args) : 64;
+    if (iters <= 0 || iters > CB_MAX_ITERS) iters = CB_MAX_ITERS;
+    uint64_t half = (1ULL << (PMM_COLOURS / 2)) - 1;  // colours [0, N/2)
+    terminal_setcolor(vga_entry_color(VGA_COLOR_YELLOW, VGA_COLOR_BLACK));
+    terminal_writestring("\n[colourbench] control 256KB vs background 4MB stream\n");
+    terminal_setcolor(vga_entry_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK));
+    colourbench_run("  uncoloured:", 0, 0, iters);
+    colourbench_run("  coloured:  ", half, half << (PMM_COLOURS / 2), iters);
+#else
+    (void)args;
+    terminal_writestring("Page colouring disabled (PMM_COLOURS = 0)\n");
+#endif
+}
 
 // Shell prompt
 static void show_prompt(void) {
@@ -592,9 +834,22 @@ static void sh_help(const char* a){ (void)a; cmd_help(); }
 static void sh_clear(const char* a){ (void)a; cmd_clear(); }
 static void sh_info(const char* a){ (void)a; cmd_info(); }
 static void sh_uptime(const char* a){ (void)a; cmd_uptime(); }
+static void sh_boottime(const char* a){ (void)a; boot_print_phases(); }
 static void sh_mem(const char* a){ (void)a; cmd_mem(); }
 static void sh_memtest(const char* a){ (void)a; cmd_memtest(); }
 static void sh_memstress(const char* a){ (void)a; cmd_memstress(); }
+static void sh_heapprof(const char* a){
+    (void)a;
+#if ENABLE_HEAP_PROFILE
+    heap_prof_report();
+#else
+    terminal_writestring("Heap profiler not built in (set ENABLE_HEAP_PROFILE 1 in config.h)\n");
+#endif
+}
+static void sh_pmminfo(const char* a){ (void)a; pmm_print_stats(); pmm_print_buddy_info(); }
+static void sh_pmmbench(const char* a){ cmd_pmmbench(a); }
+static void sh_vmmbench(const char* a){ cmd_vmmbench(a); }
+static void sh_colourbench(const char* a){ cmd_colourbench(a); }
 static void sh_colors(const char* a){ (void)a; cmd_colors(); }
 static void sh_fbinfo(const char* a){ (void)a; 
 #if ENABLE_FB
@@ -882,7 +1137,8 @@ static void sh_usertest(const char* args) {
             uint64_t st = vmm_alloc_user_stack(4);
             terminal_writestring("[OK] user stack top="); char hx[]="0123456789ABCDEF"; for(int i=60;i>=0;i-=4) terminal_putchar(hx[(st>>i)&0xF]); terminal_writestring("\n[TEST] switching to user space...\n");
             if (vmm_switch_space(us)==0) terminal_writestring("[OK] switch user CR3\n"); else terminal_writestring("[FAIL] switch user\n");
-            vmm_switch_space(vmm_get_kernel_space()); terminal_writestring("[OK] returned to kernel space\n"); }
+            vmm_switch_space(vmm_get_kernel_space()); terminal_writestring("[OK] returned to kernel space\n");
+            vmm_space_destroy(us); }
 }
 static void sh_elfload(const char* a) {
     extern process_t* process_create_from_elf(const void* elf_buf, size_t size); unsigned char elf_buf[512]; for(int i=0;i<512;i++) elf_buf[i]=0; elf_buf[0]=0x7F; elf_buf[1]='E'; elf_buf[2]='L'; elf_buf[3]='F'; elf_buf[4]=2; elf_buf[5]=1; elf_buf[6]=1; *(uint16_t*)(elf_buf+16)=2; *(uint16_t*)(elf_buf+18)=0x3E; *(uint32_t*)(elf_buf+20)=1; *(uint64_t*)(elf_buf+24)=USER_CODE_BASE; *(uint64_t*)(elf_buf+32)=64; *(uint16_t*)(elf_buf+52)=64; *(uint16_t*)(elf_buf+54)=56; *(uint16_t*)(elf_buf+56)=1; *(uint32_t*)(elf_buf+64)=1; *(uint32_t*)(elf_buf+68)=PF_R|PF_X; *(uint64_t*)(elf_buf+72)=0x100ULL; *(uint64_t*)(elf_buf+80)=USER_CODE_BASE; *(uint64_t*)(elf_buf+88)=USER_CODE_BASE; *(uint64_t*)(elf_buf+96)=0x80ULL; *(uint64_t*)(elf_buf+104)=0x80ULL; *(uint64_t*)(elf_buf+112)=0x1000ULL; for(int i=0;i<0x80;i++) elf_buf[0x100+i]=0x90; terminal_writestring("[ELFLOAD] Loading test ELF...\n"); process_t* p = process_create_from_elf(elf_buf, sizeof(elf_buf)); if(!p) terminal_writestring("[ELFLOAD] Failed\n"); else terminal_writestring("[ELFLOAD] OK (process created)\n"); }
@@ -932,7 +1188,56 @@ static void sh_elfload2(const char* a) {
     }
 static void sh_elfunload(const char* a) { extern process_t* process_get_last(void); extern process_t* process_find_by_pid(uint32_t pid); extern int process_destroy(process_t* p); uint32_t pid=0; while(*a==' ') a++; while(*a>='0'&&*a<='9'){ pid=pid*10+(*a-'0'); a++; } process_t* target = pid? process_find_by_pid(pid): process_get_last(); if(!target) terminal_writestring("[ELFUNLOAD] process not found\n"); else { int ur=process_destroy(target); if(ur==0) terminal_writestring("[ELFUNLOAD] OK (process destroyed)\n"); else terminal_writestring("[ELFUNLOAD] FAIL\n"); } }
 static void sh_ps(const char* a){ (void)a; pager_begin(); shell_ps_list(); pager_end(); }
-static void sh_kill(const char* a){ extern process_t* process_find_by_pid(uint32_t pid); extern int process_destroy(process_t*); while(*a==' ') a++; if(!*a){ terminal_writestring("Usage: kill <pid>\n"); return; } uint32_t pid=0; while(*a>='0'&&*a<='9'){ pid=pid*10+(*a-'0'); a++; } process_t* t=process_find_by_pid(pid); if(!t){ terminal_writestring("[KILL] PID not found\n"); return; } int r=process_destroy(t); if(r==0) terminal_writestring("[KILL] OK\n"); else terminal_writestring("[KILL] FAIL\n"); }
+// Costo dell'ultimo process_destroy: pagine residenti liberate, cicli TSC e microsecondi
+static void shell_print_last_kill(const char* prefix) {
+    const proc_kill_stats_t* k = process_last_kill();
+    if (!k) return;
+    char buf[32];
+    terminal_writestring(prefix);
+    terminal_writestring("last kill: PID="); itoa(k->pid, buf, 10); terminal_writestring(buf);
+    terminal_writestring(" pages="); itoa(k->pages, buf, 10); terminal_writestring(buf);
+    terminal_writestring(" cycles="); itoa(k->cycles, buf, 10); terminal_writestring(buf);
+    uint64_t khz = timer_tsc_khz();
+    if (khz) { terminal_writestring(" us="); itoa(k->cycles * 1000ULL / khz, buf, 10); terminal_writestring(buf); }
+    terminal_writestring("\n");
+}
+static void sh_kill(const char* a){ extern process_t* process_find_by_pid(uint32_t pid); extern int process_destroy(process_t*); while(*a==' ') a++; if(!*a){ terminal_writestring("Usage: kill <pid>\n"); return; } uint32_t pid=0; while(*a>='0'&&*a<='9'){ pid=pid*10+(*a-'0'); a++; } process_t* t=process_find_by_pid(pid); if(!t){ terminal_writestring("[KILL] PID not found\n"); return; } int r=process_destroy(t); if(r==0){ terminal_writestring("[KILL] OK\n"); shell_print_last_kill("[KILL] "); } else terminal_writestring("[KILL] FAIL\n"); }
+// spawn <pid> [n]: n worker copy-on-write del processo (process_fork), costo in cicli TSC
+// spawn <pid> check: fa fallire a turno ogni allocazione di vmm_clone_space e verifica che
+// il fork restituisca NULL senza lasciare riferimenti sulle pagine del padre
+static void spawn_check(process_t* parent){
+    uint64_t refs = vmm_space_refs(parent->space);
+    int steps = 0, leaks = 0;
+    char buf[24];
+    for (; steps < 4096; steps++) {
+        vmm_clone_fail_at(steps);
+        process_t* child = process_fork(parent);
+        vmm_clone_fail_at(-1);
+        if (child) { process_destroy(child); break; } // nessun punto di errore rimasto
+        if (vmm_space_refs(parent->space) != refs) leaks++;
+    }
+    if (vmm_space_refs(parent->space) != refs) leaks++;
+    terminal_writestring("[SPAWN] check: failure points="); itoa(steps, buf, 10); terminal_writestring(buf);
+    terminal_writestring(" leaks="); itoa(leaks, buf, 10); terminal_writestring(buf);
+    terminal_writestring(leaks ? " FAIL\n" : " OK\n");
+}
+static void sh_spawn(const char* a){
+    while(*a==' ') a++;
+    if(!*a){ terminal_writestring("Usage: spawn <pid> [n|check]\n"); return; }
+    uint32_t pid=0; while(*a>='0'&&*a<='9'){ pid=pid*10+(*a-'0'); a++; }
+    while(*a==' ') a++;
+    process_t* parent = process_find_by_pid(pid);
+    if(!parent){ terminal_writestring("[SPAWN] PID not found\n"); return; }
+    if (a[0]=='c' && a[1]=='h' && a[2]=='e' && a[3]=='c' && a[4]=='k') { spawn_check(parent); return; }
+    int n = *a ? (int)atoi(a) : 1;
+    if (n < 1) n = 1;
+    int got = 0;
+    uint64_t t0 = timer_rdtsc();
+    for (; got < n; got++) if (!process_fork(parent)) break;
+    uint64_t t1 = timer_rdtsc();
+    if (got < n) terminal_writestring("[SPAWN] fork failed (table full or out of memory)\n");
+    pmmbench_report("[SPAWN] fork (COW):   ", t1 - t0, got);
+}
 // Helper per decodificare flags manifest
 static void decode_manifest_flags(uint32_t f, char* out, size_t cap) {
     out[0]='\0';
@@ -968,6 +1273,7 @@ static void sh_pinfo(const char* a){
     terminal_writestring("\n  entry="); for(int i=60;i>=0;i-=4) terminal_putchar(hx[(p->entry>>i)&0xF]);
     terminal_writestring(" stack_top="); for(int i=60;i>=0;i-=4) terminal_putchar(hx[(p->stack_top>>i)&0xF]);
     terminal_writestring(" pages="); itoa(p->mapped_page_count, buf, 10); terminal_writestring(buf);
+    terminal_writestring(" rss="); itoa(vmm_space_resident(p->space, 0), buf, 10); terminal_writestring(buf);
     uint64_t memkb = p->user_mem_bytes/1024ULL; itoa(memkb, buf, 10); terminal_writestring(" memKB="); terminal_writestring(buf);
     itoa(p->cpu_ticks, buf, 10); terminal_writestring(" cpuTicks="); terminal_writestring(buf);
     // Registri (snapshot)
@@ -986,6 +1292,7 @@ static void sh_pinfo(const char* a){
         terminal_writestring("\n  Manifest: <none>");
     }
     terminal_writestring("\n");
+    shell_print_last_kill("  ");
 }
 
 // (Tabella gia' definita sopra)
@@ -1018,6 +1325,7 @@ static void ps_cb_impl(process_t* p, void* user) {
     terminal_writestring(" entry="); for(int i=60;i>=0;i-=4) terminal_putchar(hx[(p->entry>>i)&0xF]);
     terminal_writestring(" pages="); for(int i=28;i>=0;i-=4) terminal_putchar(hx[(p->mapped_page_count>>i)&0xF]);
     terminal_writestring(" memKB="); char buf[32]; itoa(memkb,buf,10); terminal_writestring(buf);
+    terminal_writestring(" rss="); itoa(vmm_space_resident(p->space, 0), buf, 10); terminal_writestring(buf);
     terminal_writestring(" cpuTicks="); itoa(p->cpu_ticks, buf, 10); terminal_writestring(buf);
     const char* st="UNKNOWN"; switch(p->state){case PROC_NEW:st="NEW";break;case PROC_READY:st="READY";break;case PROC_RUNNING:st="RUN";break;case PROC_BLOCKED:st="BLK";break;case PROC_ZOMBIE:st="ZOMB";break;} terminal_writestring(" state="); terminal_writestring(st); terminal_writestring("\n");
     ctx->count++; ctx->total_pages += p->mapped_page_count; ctx->total_cpu += p->cpu_ticks;
@@ -1044,4 +1352,5 @@ static void shell_ps_list(void) {
         }
         terminal_writestring("\n");
     }
+    shell_print_last_kill("[PS] ");
 }
\ No newline at end of file
@@ -23,7 +23,7 @@ static int check_magic(const Elf64_Ehdr* eh) {
     return 0;
 }
 
-int elf_load_image(const void* buffer, size_t size, vmm_space_t* space, uint64_t* entry_out, uint64_t** pages_out, uint32_t* page_count_out) {
+int elf_load_image(const void* buffer, size_t size, vmm_space_t* space, uint64_t* entry_out, uint32_t* page_count_out) {
     if (!buffer || size < sizeof(Elf64_Ehdr)) return ELF_ERR_FMT;
     const Elf64_Ehdr* eh = (const Elf64_Ehdr*)buffer;
     if (check_magic(eh) != 0) { terminal_writestring("[ELF] Magic err\n"); return ELF_ERR_MAGIC; }
@@ -41,25 +41,8 @@ int elf_load_image(const void* buffer, size_t size, vmm_space_t* space, uint64_t
     char hx_fb[]="0123456789ABCDEF"; for(int b=60;b>=0;b-=4) terminal_putchar(hx_fb[(free_before>>b)&0xF]); terminal_writestring("\n");
     // Itera program headers
     const uint8_t* base = (const uint8_t*)buffer;
-    // Pass 1: conteggio pagine totali PT_LOAD
-    uint32_t total_pages = 0;
-    if (pages_out && page_count_out) {
-        for (int i=0;i<eh->e_phnum;i++) {
-            const Elf64_Phdr* ph = (const Elf64_Phdr*)(base + eh->e_phoff + i * sizeof(Elf64_Phdr));
-            if (ph->p_type != PT_LOAD) continue;
-            uint64_t memsz = ph->p_memsz; if (memsz < ph->p_filesz) memsz = ph->p_filesz;
-            if (memsz == 0) continue;
-            uint64_t start = ph->p_vaddr & ~0xFFFULL;
-            uint64_t end = (ph->p_vaddr + memsz + 0xFFFULL) & ~0xFFFULL;
-            total_pages += (uint32_t)((end - start) >> 12);
-        }
-    }
-    uint64_t* pages_arr = NULL;
+    // Pagine virtuali dei PT_LOAD (footprint): nessuna lista, l'unload percorre le tabelle
     uint32_t pages_idx = 0;
-    if (pages_out && page_count_out && total_pages) {
-        pages_arr = (uint64_t*)kmalloc(sizeof(uint64_t)*total_pages);
-        if (!pages_arr) { terminal_writestring("[ELF] alloc pages_arr fail\n"); total_pages = 0; }
-    }
     for (int i=0;i<eh->e_phnum;i++) {
         const Elf64_Phdr* ph = (const Elf64_Phdr*)(base + eh->e_phoff + i * sizeof(Elf64_Phdr));
         if ((const uint8_t*)ph + sizeof(Elf64_Phdr) > base + size) return ELF_ERR_RANGE;
@@ -80,54 +63,53 @@ int elf_load_image(const void* buffer, size_t size, vmm_space_t* space, uint64_t
         uint64_t memsz = ph->p_memsz;
         uint64_t filesz = ph->p_filesz;
         if (memsz < filesz) memsz = filesz; // sanità
-    // Check p_align (richiediamo 0x1000 o 0)
-    if (ph->p_align != 0 && ph->p_align != 0x1000ULL) { terminal_writestring("[ELF] p_align non supportato\n"); return ELF_ERR_FMT; }
+    // Check p_align (0, 0x1000 o 0x200000: i segmenti allineati a 2MB usano pagine huge)
+    if (ph->p_align != 0 && ph->p_align != 0x1000ULL && ph->p_align != 0x200000ULL) { terminal_writestring("[ELF] p_align non supportato\n"); return ELF_ERR_FMT; }
         if (memsz == 0) continue;
         // Allineamento pagine
         uint64_t start = vaddr & ~0xFFFULL;
         uint64_t end = (vaddr + memsz + 0xFFFULL) & ~0xFFFULL;
         int exec = (ph->p_flags & PF_X) ? 1 : 0;
         int rw   = (ph->p_flags & PF_W) ? 1 : 0;
-        // Mappa pagine
-        for (uint64_t va = start; va < end; va += 0x1000ULL) {
-            int r = 0;
-            if (exec && !rw) r = vmm_map_user_code_in_space(space, va);
-            else r = vmm_alloc_user_page_in_space(space, va); // RW NX
-            if (r != 0) { terminal_writestring("[ELF] map fallita (r)"); char hx2[]="0123456789ABCDEF"; for(int b=4;b>=0;b-=4) terminal_putchar(hx2[(r>>b)&0xF]); terminal_writestring(" virt="); for(int b=60;b>=0;b-=4) terminal_putchar(hx2[(va>>b)&0xF]); terminal_writestring("\n"); return ELF_ERR_MAP; }
-            // Logging dettagli pagina
-            terminal_writestring("[ELF] page ");
-            char hx[]="0123456789ABCDEF"; for(int b=60;b>=0;b-=4) terminal_putchar(hx[(va>>b)&0xF]);
-            terminal_writestring(" -> "); terminal_putchar(exec? 'X':'-'); terminal_putchar(rw? 'W':'R'); terminal_writestring("\n");
-            if (pages_arr && pages_idx < total_pages) pages_arr[pages_idx++] = va;
+        // Mappa subito solo le pagine con dati del file, con un solo walk per 2MB (codice RX,
+        // resto RW NX). Le pagine solo-BSS restano in una VMA: azzerate al primo accesso.
+        // Con p_align 2MB il segmento e' mappato tutto, ogni finestra di 2MB coperta
+        // interamente diventa una pagina huge.
+        int huge = (ph->p_align == 0x200000ULL);
+        uint64_t seg_flags = VMM_FLAG_USER | ((exec && !rw) ? 0 : (VMM_FLAG_RW | VMM_FLAG_NOEXEC));
+        if (huge) seg_flags |= VMM_MAP_HUGE;
+        uint64_t eager_end = huge ? end : ((vaddr + filesz + 0xFFFULL) & ~0xFFFULL);
+        if (eager_end < end && vmm_vma_add(space, eager_end, end - eager_end, seg_flags) != 0) {
+            terminal_writestring("[ELF] VMA bss fallita, mapping immediato\n");
+            eager_end = end;
         }
-        // Copia contenuto file nelle pagine (solo filesz)
+        int r = eager_end > start ? vmm_map_range(space, start, VMM_MAP_ALLOC, (eager_end - start) >> 12, seg_flags) : 0;
+        if (r != 0) { terminal_writestring("[ELF] map fallita (r)"); char hx2[]="0123456789ABCDEF"; for(int b=4;b>=0;b-=4) terminal_putchar(hx2[(r>>b)&0xF]); terminal_writestring(" virt="); for(int b=60;b>=0;b-=4) terminal_putchar(hx2[(start>>b)&0xF]); terminal_writestring("\n"); return ELF_ERR_MAP; }
+        pages_idx += (uint32_t)((end - start) >> 12);
+        // Copia contenuto file nelle pagine (solo filesz), una traduzione per pagina.
+        // La coda memsz > filesz e' gia' zero: VMM_MAP_ALLOC usa frame azzerati, le pagine
+        // oltre eager_end arrivano azzerate dal fault handler.
         const uint8_t* src = base + ph->p_offset;
-        for (uint64_t off = 0; off < filesz; off++) {
+        for (uint64_t off = 0; off < filesz; ) {
             uint64_t va = vaddr + off;
             uint64_t phys = vmm_translate_in_space(space, va);
             if (!phys) { terminal_writestring("[ELF] translate fail space\n"); return ELF_ERR_MAP; }
             uint8_t* dst = (uint8_t*)phys_to_virt(phys);
-            dst[va & 0xFFFULL] = src[off];
-        }
-        // Zero tail se memsz > filesz
-        for (uint64_t off = filesz; off < memsz; off++) {
-            uint64_t va = vaddr + off;
-            uint64_t phys = vmm_translate_in_space(space, va);
-            if (!phys) continue;
-            uint8_t* dst = (uint8_t*)phys_to_virt(phys);
-            dst[va & 0xFFFULL] = 0;
+            uint64_t chunk = 0x1000ULL - (va & 0xFFFULL);
+            if (chunk > filesz - off) chunk = filesz - off;
+            for (uint64_t b = 0; b < chunk; b++) dst[b] = src[off + b];
+            off += chunk;
         }
         terminal_writestring("[ELF] Segmento caricato: vaddr=");
         char hx[]="0123456789ABCDEF"; for(int b=60;b>=0;b-=4) terminal_putchar(hx[(vaddr>>b)&0xF]);
         terminal_writestring(" size=");
         for(int b=60;b>=0;b-=4) terminal_putchar(hx[(memsz>>b)&0xF]);
         terminal_writestring(" flags=");
-        terminal_putchar(exec?'X':'-'); terminal_putchar(rw?'W':'R'); terminal_writestring("\n");
+        terminal_putchar(exec?'X':'-'); terminal_putchar(rw?'W':'R');
+        if (huge) terminal_writestring(" huge");
+        terminal_writestring("\n");
     }
     terminal_writestring("[ELF] Caricamento completato\n");
-    if (pages_out && page_count_out) {
-        *pages_out = pages_arr;
-        *page_count_out = pages_idx;
-    }
+    if (page_count_out) *page_count_out = pages_idx;
     return ELF_OK;
 }
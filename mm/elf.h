@@ -65,7 +65,9 @@ typedef struct {
 // size: dimensione del buffer
 // space: address space user dove mappare
 // entry_out: ritorna entry point virtuale
-int elf_load_image(const void* buffer, size_t size, vmm_space_t* space, uint64_t* entry_out, uint64_t** pages_out, uint32_t* page_count_out);
+// page_count_out: pagine virtuali dei segmenti PT_LOAD (residenti o lazy)
+int elf_load_image(const void* buffer, size_t size, vmm_space_t* space, uint64_t* entry_out, uint32_t* page_count_out);
 int elf_unload_process(struct process* p); // forward dichiarazione process
+void elf_unload_report(const struct process* p, uint64_t pages); // log "[ELFUNLOAD] PID pages"
 
 #endif // ELF_H
@@ -18,6 +18,7 @@ int elf_manifest_parse(const void* elf_buf, size_t size, elf_manifest_t* out) {
     // Scansiona PHDR in cerca di PT_NOTE
     const Elf64_Phdr* ph;
     const elf_manifest_raw_t* raw = NULL;
+    uint32_t raw_size = 0;
     for (int i=0;i<eh->e_phnum;i++) {
         ph = (const Elf64_Phdr*)(base + eh->e_phoff + i*sizeof(Elf64_Phdr));
         if ((const uint8_t*)ph + sizeof(Elf64_Phdr) > base + size) return MANIFEST_ERR_RANGE;
@@ -37,8 +38,9 @@ int elf_manifest_parse(const void* elf_buf, size_t size, elf_manifest_t* out) {
             if (namesz && descsz && type == SECOS_NOTE_TYPE) {
                 // Verifica nome
                 if (namesz >= sizeof(SECOS_NOTE_NAME) && name[0]=='S' && name[1]=='E' && name[2]=='C' && name[3]=='O' && name[4]=='S') {
-                    if (descsz >= sizeof(elf_manifest_raw_t)) {
+                    if (descsz >= MANIFEST_RAW_MIN_SIZE) {
                         raw = (const elf_manifest_raw_t*)desc;
+                        raw_size = descsz;
                         break;
                     }
                 }
@@ -52,6 +54,7 @@ int elf_manifest_parse(const void* elf_buf, size_t size, elf_manifest_t* out) {
     out->flags   = raw->flags;
     out->max_mem = raw->max_mem;
     out->entry_hint = raw->entry_hint;
+    out->colour_mask = (raw_size >= sizeof(elf_manifest_raw_t)) ? raw->colour_mask : 0;
     terminal_writestring("[MANIFEST] parsed versione=");
     char hx[]="0123456789ABCDEF"; for(int i=4;i>=0;i-=4) terminal_putchar(hx[(out->version>>i)&0xF]);
     terminal_writestring(" flags="); for(int i=31;i>=0;i-=4) terminal_putchar(hx[(out->flags>>i)&0xF]); terminal_writestring("\n");
@@ -35,14 +35,19 @@ typedef struct elf_manifest_raw {
     uint32_t flags;       // bitmask flags
     uint64_t max_mem;     // limite massimo memoria virtuale che il processo può mappare (placeholder)
     uint64_t entry_hint;  // entry point atteso, 0 = ignora
+    uint64_t colour_mask; // opzionale: colori LLC ammessi per le pagine utente (0 = qualsiasi)
 } elf_manifest_raw_t;
 
+// Dimensione minima desc (manifest senza colour_mask)
+#define MANIFEST_RAW_MIN_SIZE 24
+
 // Struttura interna usata dal kernel (espande se servono campi derivati)
 typedef struct elf_manifest {
     uint32_t version;
     uint32_t flags;
     uint64_t max_mem;
     uint64_t entry_hint;
+    uint64_t colour_mask; // 0 se assente nel desc
 } elf_manifest_t;
 
 int elf_manifest_parse(const void* elf_buf, size_t size, elf_manifest_t* out);
@@ -13,32 +13,29 @@
 
 #define ADDRESS_MASK 0x000FFFFFFFFFF000ULL
 
-// Semplice elfunload: smappa pagine user code/data del processo (non gestisce refcount né stack condivisi)
-// Assunzioni: process_t->space esiste, segmenti ELF sono contigui a partire da USER_CODE_BASE / USER_DATA_BASE.
-// Reale implementazione dovrebbe tracciare ogni pagina mappata. Qui usiamo heuristica su range.
+// Unload: un'unica discesa nelle tabelle della meta' user (vmm_unmap_user). Sottoalberi vuoti
+// saltati, run contigue di frame esclusivi liberate in blocco, un solo flush TLB.
+// Niente lista di pagine nel PCB: anche le pagine arrivate per fault (VMA) vengono liberate.
 
-// Ora usiamo tracking reale: PCB contiene p->mapped_pages e p->mapped_page_count
+// Log dell'unload separato dal teardown: chi misura il teardown (process_destroy) stampa
+// dopo aver letto il TSC, cosi' l'output su console non entra nei cicli misurati
+void elf_unload_report(const process_t* p, uint64_t pages) {
+    if (!p) return;
+    terminal_writestring("[ELFUNLOAD] PID=");
+    char hx[]="0123456789ABCDEF"; for(int i=28;i>=0;i-=4) terminal_putchar(hx[(p->pid>>i)&0xF]);
+    terminal_writestring(" pages=");
+    uint64_t v=pages; if (v==0) terminal_putchar('0'); else {
+        char tmp[16]; int idx=0; while(v>0){ tmp[idx++]=hx[v & 0xF]; v >>=4; }
+        while(idx>0) terminal_putchar(tmp[--idx]);
+    }
+    terminal_writestring("\n");
+}
 
 int elf_unload_process(process_t* p) {
     if (!p) return -1;
     vmm_space_t* space = p->space;
     if (!space) return -2;
-    terminal_writestring("[ELFUNLOAD] start PID=");
-    char hx[]="0123456789ABCDEF"; for(int i=28;i>=0;i-=4) terminal_putchar(hx[(p->pid>>i)&0xF]); terminal_writestring("\n");
-    int pages_freed = 0;
-    if (p->mapped_pages) {
-        for (uint32_t i=0;i<p->mapped_page_count;i++) {
-            uint64_t va = p->mapped_pages[i];
-            if (vmm_unmap_in_space(space, va) == 0) pages_freed++;
-        }
-    }
-    terminal_writestring("[ELFUNLOAD] done pages=");
-    char hx2[]="0123456789ABCDEF"; int v=pages_freed; if (v==0) terminal_putchar('0'); else {
-        char tmp[16]; int idx=0; while(v>0){ tmp[idx++]=hx2[v & 0xF]; v >>=4; }
-        while(idx>0) terminal_putchar(tmp[--idx]);
-    }
-    terminal_writestring("\n");
-    // Libera lista pagine
-    if (p->mapped_pages) { kfree(p->mapped_pages); p->mapped_pages=NULL; p->mapped_page_count=0; }
+    uint64_t pages_freed = vmm_unmap_user(space);
+    elf_unload_report(p, pages_freed);
     return 0;
 }
@@ -6,26 +6,295 @@
  */
 #include "heap.h"
 #include "pmm.h"
+#include "vmm.h" // kernel heap arena / vmalloc area mappings
 #include "terminal.h"
+#include "config.h" // ENABLE_DEBUG_LOG, ENABLE_HEAP_PROFILE
 
-// Header for each heap block
+// Trace of the list allocator (very verbose: one line per step)
+#if ENABLE_DEBUG_LOG
+#define HEAP_DBG(msg) terminal_writestring(msg)
+#else
+#define HEAP_DBG(msg) do { } while (0)
+#endif
+
+// Arena blocks use boundary tags: a 16-byte header {size, used} and an 8-byte footer
+// holding the size again, so both neighbours of a block are found in O(1). Sizes cover
+// the whole block (header + payload + footer) and are multiples of 16, which keeps
+// payloads 16-byte aligned. Free blocks keep their free-list links in the payload.
 typedef struct heap_block {
-    size_t size;
-    bool is_free;
-    struct heap_block* next;
+    uint64_t size;
+    uint64_t used;
+    struct heap_block* next_free; // valid only while free
+    struct heap_block* prev_free;
 } heap_block_t;
 
-#define HEAP_BLOCK_HEADER_SIZE sizeof(heap_block_t)
+#define HEAP_BLOCK_HEADER_SIZE 16
+#define HEAP_BLOCK_FOOTER_SIZE 8
+#define HEAP_BLOCK_OVERHEAD    (HEAP_BLOCK_HEADER_SIZE + HEAP_BLOCK_FOOTER_SIZE)
+#define HEAP_MIN_BLOCK         48 // header + links + footer, rounded to 16
+#define HEAP_PROLOGUE_SIZE     32 // used block at the arena start: no left neighbour check
+
+// Segregated free lists: bin i holds free blocks with floor(log2(size)) == i + 5, so
+// every block in a higher bin fits any request of a lower one. bin_map has bit i set
+// when bin i is non-empty.
+#define HEAP_BINS 26 // 32 B .. 1 GB (VMM_KHEAP_SIZE)
 
+// The list heap lives in a virtually contiguous arena at VMM_KHEAP_BASE that grows by
+// mapping frames at its end, so blocks may span pages whatever frames back them. The
+// last 16 bytes of the mapped arena are an epilogue header (size 0, used).
 static heap_block_t* heap_start = NULL;
+static uint64_t heap_end = VMM_KHEAP_BASE; // first unmapped byte of the arena
+static heap_block_t* heap_bins[HEAP_BINS];
+static uint32_t heap_bin_map = 0;
+static uint64_t heap_free_blocks = 0;
+static uint64_t heap_free_bytes = 0;
 static uint64_t total_allocated = 0;
 static uint64_t total_freed = 0;
 
+#if ENABLE_HEAP_PROFILE
+// Allocation profiler: one record per live allocation (pointer, caller return address,
+// size, owner pid) in an open-addressing hash table keyed by pointer. Records are
+// removed with backward-shift deletion, so lookups never cross tombstones. Allocations
+// beyond 3/4 of the table are counted as dropped instead of recorded.
+#define HEAP_PROF_SLOTS   4096  // power of two
+#define HEAP_PROF_ORPHAN  0x80000000u // owner bit: survived process_destroy()
+#define HEAP_PROF_SITES   128   // distinct call sites aggregated by heapprof
+
+typedef struct heap_prof_rec {
+    uint64_t ptr;   // 0 = empty slot
+    uint64_t site;
+    uint64_t size;
+    uint32_t owner; // pid that caused the allocation (0 = kernel) | HEAP_PROF_ORPHAN
+    uint32_t pad;
+} heap_prof_rec_t;
+
+static heap_prof_rec_t prof_tab[HEAP_PROF_SLOTS];
+static uint64_t prof_live = 0;
+static uint64_t prof_dropped = 0;
+static uint32_t prof_owner = 0;
+
+static inline uint32_t prof_slot(uint64_t ptr) {
+    return (uint32_t)(((ptr >> 4) * 0x9E3779B97F4A7C15ULL) >> 52) & (HEAP_PROF_SLOTS - 1);
+}
+
+static void heap_prof_alloc(void* ptr, uint64_t size, void* site) {
+    if (!ptr) return;
+    if (prof_live >= HEAP_PROF_SLOTS / 4 * 3) { prof_dropped++; return; }
+    uint32_t i = prof_slot((uint64_t)ptr);
+    while (prof_tab[i].ptr && prof_tab[i].ptr != (uint64_t)ptr) i = (i + 1) & (HEAP_PROF_SLOTS - 1);
+    if (!prof_tab[i].ptr) prof_live++;
+    prof_tab[i].ptr = (uint64_t)ptr;
+    prof_tab[i].site = (uint64_t)site;
+    prof_tab[i].size = size;
+    prof_tab[i].owner = prof_owner;
+}
+
+static void heap_prof_free(void* ptr) {
+    uint32_t i = prof_slot((uint64_t)ptr);
+    while (prof_tab[i].ptr != (uint64_t)ptr) {
+        if (!prof_tab[i].ptr) return; // not recorded (heap metadata or dropped)
+        i = (i + 1) & (HEAP_PROF_SLOTS - 1);
+    }
+    // Backward shift: pull later entries of the cluster into the hole when their home
+    // slot does not lie (cyclically) between the hole and their current slot
+    uint32_t hole = i;
+    for (uint32_t j = (i + 1) & (HEAP_PROF_SLOTS - 1); prof_tab[j].ptr; j = (j + 1) & (HEAP_PROF_SLOTS - 1)) {
+        uint32_t home = prof_slot(prof_tab[j].ptr);
+        if (((j - home) & (HEAP_PROF_SLOTS - 1)) >= ((j - hole) & (HEAP_PROF_SLOTS - 1))) {
+            prof_tab[hole] = prof_tab[j];
+            hole = j;
+        }
+    }
+    prof_tab[hole].ptr = 0;
+    prof_live--;
+}
+
+#define HEAP_PROF_ALLOC(p, sz) heap_prof_alloc((p), (sz), __builtin_return_address(0))
+#define HEAP_PROF_FREE(p)      heap_prof_free(p)
+#else
+#define HEAP_PROF_ALLOC(p, sz) do { } while (0)
+#define HEAP_PROF_FREE(p)      do { } while (0)
+#endif
+
+static void* heap_alloc(size_t size);
+
 // Helper to align addresses
 static inline size_t align_up(size_t size, size_t alignment) {
     return (size + alignment - 1) & ~(alignment - 1);
 }
 
+// Slab layer: requests up to SLAB_MAX_SIZE are served from per-class slabs. A slab is one
+// frame used through the physmap: a header with the bitmap of free objects, then objects.
+// Classes are powers of two and their 1.5x midpoints (internal waste < 33%). Slab frames
+// carry PMM_PAGE_SLAB in their struct page so kfree() tells them from list-heap frames.
+// Only odd sizes (> SLAB_MAX_SIZE) still go through the boundary-tag arena below.
+// The kmalloc classes are kmem caches like the typed ones of kmem_cache_create().
+#define SLAB_MAX_SIZE  2048
+#define SLAB_HDR_SIZE  64      // objects start here (keeps 16-byte alignment)
+#define SLAB_MAP_WORDS 4       // (4096 - 64) / 16 = 252 objects max
+#define SLAB_COLOUR_STEP 64    // cache line
+
+static const uint16_t slab_sizes[] = {
+    16, 24, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048
+};
+#define SLAB_CLASSES (sizeof(slab_sizes) / sizeof(slab_sizes[0]))
+
+typedef struct slab {
+    struct slab* next;                  // partial list of the cache
+    struct slab* prev;
+    struct kmem_cache* cache;
+    uint16_t offset;                    // first object (SLAB_HDR_SIZE + colour)
+    uint16_t inuse;
+    uint16_t total;
+    uint16_t on_partial;
+    uint64_t free_map[SLAB_MAP_WORDS];  // bit set = object free
+} slab_t;
+
+struct kmem_cache {
+    const char* name;
+    uint32_t size;        // object size (multiple of the alignment)
+    uint32_t colour_max;  // unused bytes per slab, rounded down to SLAB_COLOUR_STEP
+    uint32_t colour_next; // offset of the next new slab's objects past the header
+    void (*ctor)(void*);  // run once per object when its slab is created
+    slab_t* partial;      // slabs with at least one free object
+    uint64_t slabs;       // frames owned by the cache
+    uint64_t inuse;       // objects handed out
+    uint64_t allocs;
+    uint64_t frees;
+    struct kmem_cache* next; // list of typed caches (heap_print_stats)
+};
+
+static kmem_cache_t slab_classes[SLAB_CLASSES];
+static uint8_t slab_index[SLAB_MAX_SIZE / 8 + 1]; // (size + 7) / 8 -> class
+static kmem_cache_t* kmem_caches = NULL;
+
+static void slab_init(void) {
+    unsigned c = 0;
+    for (unsigned i = 0; i <= SLAB_MAX_SIZE / 8; i++) {
+        while (slab_sizes[c] < i * 8) c++;
+        slab_index[i] = (uint8_t)c;
+    }
+    // No colouring: kmalloc_aligned() relies on objects at SLAB_HDR_SIZE + k * size
+    for (c = 0; c < SLAB_CLASSES; c++) slab_classes[c].size = slab_sizes[c];
+}
+
+static void slab_partial_push(kmem_cache_t* sc, slab_t* s) {
+    s->prev = NULL;
+    s->next = sc->partial;
+    if (sc->partial) sc->partial->prev = s;
+    sc->partial = s;
+    s->on_partial = 1;
+}
+
+static void slab_partial_remove(kmem_cache_t* sc, slab_t* s) {
+    if (s->prev) s->prev->next = s->next; else sc->partial = s->next;
+    if (s->next) s->next->prev = s->prev;
+    s->next = s->prev = NULL;
+    s->on_partial = 0;
+}
+
+// New empty slab for a cache (one frame, any zone). Successive slabs shift their objects
+// by one cache line within the unused tail, so the same object index of different slabs
+// does not always land in the same cache set.
+static slab_t* slab_new(kmem_cache_t* sc) {
+    void* frame = pmm_alloc_frame();
+    if (!frame) return NULL;
+    pmm_page_set_flags((uint64_t)frame, PMM_PAGE_KERNEL | PMM_PAGE_SLAB);
+    slab_t* s = (slab_t*)phys_to_virt((uint64_t)frame);
+    s->cache = sc;
+    s->offset = (uint16_t)(SLAB_HDR_SIZE + sc->colour_next);
+    sc->colour_next = sc->colour_next + SLAB_COLOUR_STEP > sc->colour_max ? 0 : sc->colour_next + SLAB_COLOUR_STEP;
+    s->inuse = 0;
+    s->total = (uint16_t)((PMM_FRAME_SIZE - s->offset) / sc->size);
+    for (unsigned w = 0; w < SLAB_MAP_WORDS; w++) {
+        unsigned first = w * 64;
+        if (first >= s->total) s->free_map[w] = 0;
+        else if (s->total - first >= 64) s->free_map[w] = ~0ULL;
+        else s->free_map[w] = (1ULL << (s->total - first)) - 1;
+    }
+    if (sc->ctor) {
+        for (unsigned i = 0; i < s->total; i++) sc->ctor((uint8_t*)s + s->offset + (size_t)i * sc->size);
+    }
+    slab_partial_push(sc, s);
+    sc->slabs++;
+    return s;
+}
+
+// O(1): first free object of the first partial slab
+static void* slab_alloc(kmem_cache_t* sc) {
+    slab_t* s = sc->partial;
+    if (!s && !(s = slab_new(sc))) return NULL;
+    unsigned w = 0;
+    while (!s->free_map[w]) w++;
+    unsigned idx = w * 64 + (unsigned)__builtin_ctzll(s->free_map[w]);
+    s->free_map[w] &= ~(1ULL << (idx % 64));
+    if (++s->inuse == s->total) slab_partial_remove(sc, s);
+    sc->inuse++;
+    sc->allocs++;
+    total_allocated += sc->size;
+    return (uint8_t*)s + s->offset + (size_t)idx * sc->size;
+}
+
+// O(1): the slab header is at the start of the object's frame. An empty slab goes back
+// to the PMM unless it is the only partial slab of its cache (avoids alloc/free ping-pong).
+static void slab_free(void* ptr) {
+    slab_t* s = (slab_t*)((uint64_t)ptr & ~(uint64_t)(PMM_FRAME_SIZE - 1));
+    kmem_cache_t* sc = s->cache;
+    if ((uint64_t)ptr < (uint64_t)s + s->offset) return;                     // not an object
+    uint64_t off = (uint64_t)ptr - (uint64_t)s - s->offset;
+    unsigned idx = (unsigned)(off / sc->size);
+    if (idx >= s->total || off % sc->size) return;                           // not an object start
+    if (s->free_map[idx / 64] & (1ULL << (idx % 64))) return;                // already free
+    s->free_map[idx / 64] |= 1ULL << (idx % 64);
+    s->inuse--;
+    sc->inuse--;
+    sc->frees++;
+    total_freed += sc->size;
+    if (!s->on_partial) slab_partial_push(sc, s);
+    if (s->inuse == 0 && (sc->partial != s || s->next)) {
+        slab_partial_remove(sc, s);
+        sc->slabs--;
+        pmm_page_clear_flags(virt_to_phys((uint64_t)s), PMM_PAGE_SLAB);
+        pmm_free_frame((void*)virt_to_phys((uint64_t)s));
+    }
+}
+
+kmem_cache_t* kmem_cache_create(const char* name, size_t size, size_t align, void (*ctor)(void*)) {
+    if (align < 8) align = 8;
+    if (align & (align - 1)) return NULL;
+    size = align_up(size < 16 ? 16 : size, align);
+    if (align > SLAB_COLOUR_STEP || size > PMM_FRAME_SIZE - SLAB_HDR_SIZE) return NULL;
+    kmem_cache_t* sc = (kmem_cache_t*)heap_alloc(sizeof(kmem_cache_t));
+    if (!sc) return NULL;
+    uint64_t total = (PMM_FRAME_SIZE - SLAB_HDR_SIZE) / size;
+    uint64_t spare = PMM_FRAME_SIZE - SLAB_HDR_SIZE - total * size;
+    sc->name = name;
+    sc->size = (uint32_t)size;
+    sc->colour_max = (uint32_t)(spare & ~(uint64_t)(SLAB_COLOUR_STEP - 1));
+    sc->colour_next = 0;
+    sc->ctor = ctor;
+    sc->partial = NULL;
+    sc->slabs = sc->inuse = sc->allocs = sc->frees = 0;
+    sc->next = kmem_caches;
+    kmem_caches = sc;
+    return sc;
+}
+
+void* kmem_cache_alloc(kmem_cache_t* cache) {
+    if (!cache) return NULL;
+    void* obj = slab_alloc(cache);
+    HEAP_PROF_ALLOC(obj, cache->size);
+    return obj;
+}
+
+void kmem_cache_free(kmem_cache_t* cache, void* obj) {
+    if (!cache || !obj) return;
+    HEAP_PROF_FREE(obj);
+    slab_t* s = (slab_t*)((uint64_t)obj & ~(uint64_t)(PMM_FRAME_SIZE - 1));
+    if (s->cache != cache) return; // object of another cache
+    slab_free(obj);
+}
+
 // Convert number to decimal string
 static void itoa_dec(uint64_t value, char* buffer) {
     if (value == 0) {
@@ -49,22 +318,158 @@ static void itoa_dec(uint64_t value, char* buffer) {
     buffer[j] = '\0';
 }
 
+// vmalloc area: whole-page objects, each followed by an unmapped guard page so a linear
+// overflow faults instead of corrupting the next object. Areas are kept in an address
+// sorted list (descriptors from the 24-byte slab class); placement is first fit.
+typedef struct vm_area {
+    uint64_t start;
+    uint64_t pages;
+    struct vm_area* next;
+} vm_area_t;
+
+static vm_area_t* vm_areas = NULL;
+static uint64_t vm_area_count = 0;
+static uint64_t vm_mapped_pages = 0;
+
+// Map 'pages' fresh frames at virt; on failure the pages mapped so far are released
+static int map_kernel_pages(uint64_t virt, uint64_t pages) {
+    for (uint64_t i = 0; i < pages; i++) {
+        void* frame = pmm_alloc_frame();
+        if (frame) {
+            pmm_page_set_flags((uint64_t)frame, PMM_PAGE_KERNEL);
+            if (vmm_map(virt + i * PMM_FRAME_SIZE, (uint64_t)frame, VMM_FLAG_RW | VMM_FLAG_NOEXEC | VMM_FLAG_GLOBAL) == 0) continue;
+            pmm_free_frame(frame);
+        }
+        vmm_unmap_range(NULL, virt, i);
+        return -1;
+    }
+    return 0;
+}
+
+// First gap of the vmalloc area where an 'align'-aligned object fits (align: power of
+// two >= PMM_FRAME_SIZE). The guard page of the previous area stays in front of it.
+static void* vmalloc_aligned(size_t size, uint64_t align) {
+    if (size == 0) return NULL;
+    uint64_t pages = (size + PMM_FRAME_SIZE - 1) / PMM_FRAME_SIZE;
+    uint64_t span = (pages + 1) * PMM_FRAME_SIZE;           // object + trailing guard
+    uint64_t cursor = align_up(VMM_VMALLOC_BASE + PMM_FRAME_SIZE, align); // leading guard for the first area
+    vm_area_t** link = &vm_areas;
+    while (*link && (*link)->start < cursor + span) {
+        cursor = align_up((*link)->start + ((*link)->pages + 1) * PMM_FRAME_SIZE, align);
+        link = &(*link)->next;
+    }
+    if (cursor + span > VMM_VMALLOC_BASE + VMM_VMALLOC_SIZE) return NULL;
+    vm_area_t* a = (vm_area_t*)heap_alloc(sizeof(vm_area_t));
+    if (!a) return NULL;
+    if (map_kernel_pages(cursor, pages) != 0) { kfree(a); return NULL; }
+    a->start = cursor;
+    a->pages = pages;
+    a->next = *link;
+    *link = a;
+    vm_area_count++;
+    vm_mapped_pages += pages;
+    total_allocated += pages * PMM_FRAME_SIZE;
+    return (void*)cursor;
+}
+
+void* vmalloc(size_t size) {
+    void* ptr = vmalloc_aligned(size, PMM_FRAME_SIZE);
+    HEAP_PROF_ALLOC(ptr, size);
+    return ptr;
+}
+
+void vfree(void* ptr) {
+    if (!ptr) return;
+    HEAP_PROF_FREE(ptr);
+    vm_area_t** link = &vm_areas;
+    while (*link && (*link)->start != (uint64_t)ptr) link = &(*link)->next;
+    vm_area_t* a = *link;
+    if (!a) return; // not the start of a vmalloc object
+    vmm_unmap_range(NULL, a->start, a->pages);
+    *link = a->next;
+    vm_area_count--;
+    vm_mapped_pages -= a->pages;
+    total_freed += a->pages * PMM_FRAME_SIZE;
+    kfree(a);
+}
+
+static inline heap_block_t* block_next(heap_block_t* b) {
+    return (heap_block_t*)((uint8_t*)b + b->size);
+}
+
+static inline void block_set(heap_block_t* b, uint64_t size, uint64_t used) {
+    b->size = size;
+    b->used = used;
+    *(uint64_t*)((uint8_t*)b + size - HEAP_BLOCK_FOOTER_SIZE) = size;
+}
+
+static inline unsigned heap_bin(uint64_t size) {
+    unsigned bin = 63u - (unsigned)__builtin_clzll(size) - 5u;
+    return bin < HEAP_BINS ? bin : HEAP_BINS - 1;
+}
+
+static void heap_bin_insert(heap_block_t* b) {
+    unsigned bin = heap_bin(b->size);
+    b->prev_free = NULL;
+    b->next_free = heap_bins[bin];
+    if (heap_bins[bin]) heap_bins[bin]->prev_free = b;
+    heap_bins[bin] = b;
+    heap_bin_map |= 1u << bin;
+    heap_free_blocks++;
+    heap_free_bytes += b->size;
+}
+
+static void heap_bin_remove(heap_block_t* b) {
+    unsigned bin = heap_bin(b->size);
+    if (b->prev_free) b->prev_free->next_free = b->next_free; else heap_bins[bin] = b->next_free;
+    if (b->next_free) b->next_free->prev_free = b->prev_free;
+    if (!heap_bins[bin]) heap_bin_map &= ~(1u << bin);
+    heap_free_blocks--;
+    heap_free_bytes -= b->size;
+}
+
+// Merge a free block (not in any bin) with its free neighbours and file the result
+static heap_block_t* heap_coalesce(heap_block_t* b) {
+    heap_block_t* next = block_next(b);
+    if (!next->used) {
+        heap_bin_remove(next);
+        block_set(b, b->size + next->size, 0);
+    }
+    uint64_t prev_size = *(uint64_t*)((uint8_t*)b - HEAP_BLOCK_FOOTER_SIZE);
+    heap_block_t* prev = (heap_block_t*)((uint8_t*)b - prev_size);
+    if (!prev->used) {
+        heap_bin_remove(prev);
+        block_set(prev, prev->size + b->size, 0);
+        b = prev;
+    }
+    heap_bin_insert(b);
+    return b;
+}
+
 // Initialize heap
 void heap_init(void) {
-    // Allocate the first frame for the heap
-    heap_start = (heap_block_t*)pmm_alloc_frame();
-    
-    if (heap_start == NULL) {
+    slab_init();
+    // Map the first arena page. This also creates the PML4 entry shared by the arena and
+    // the vmalloc area before any user space copies the kernel PML4 entries, so later
+    // heap mappings are visible in every address space.
+    if (map_kernel_pages(VMM_KHEAP_BASE, 1) != 0) {
         terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_RED, VGA_COLOR_BLACK));
         terminal_writestring("[ERROR] Unable to allocate initial heap!\n");
-        terminal_writestring("[DEBUG] pmm_alloc_frame() returned NULL\n");
+        terminal_writestring("[DEBUG] heap arena map failed\n");
         terminal_setcolor(vga_entry_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK));
         return;
     }
+    heap_start = (heap_block_t*)VMM_KHEAP_BASE;
+    heap_end = VMM_KHEAP_BASE + PMM_FRAME_SIZE;
     
-    heap_start->size = PMM_FRAME_SIZE - HEAP_BLOCK_HEADER_SIZE;
-    heap_start->is_free = true;
-    heap_start->next = NULL;
+    // prologue | one free block | epilogue
+    block_set(heap_start, HEAP_PROLOGUE_SIZE, 1);
+    heap_block_t* first = block_next(heap_start);
+    block_set(first, PMM_FRAME_SIZE - HEAP_PROLOGUE_SIZE - HEAP_BLOCK_HEADER_SIZE, 0);
+    heap_block_t* epilogue = block_next(first);
+    epilogue->size = 0;
+    epilogue->used = 1;
+    heap_bin_insert(first);
     
     terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_GREEN, VGA_COLOR_BLACK));
     terminal_writestring("[OK] Heap initialized @ ");
@@ -81,42 +486,80 @@ void heap_init(void) {
     terminal_setcolor(vga_entry_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK));
 }
 
-// Expand heap by allocating a new physical frame
-static heap_block_t* expand_heap(size_t required_size) {
-    // Find last block
-    heap_block_t* current = heap_start;
-    while (current->next != NULL) {
-        current = current->next;
-    }
+// Grow the arena by enough pages for a block of 'bsize' bytes. The old epilogue becomes
+// the header of the new free block, which is merged with a free last block.
+static heap_block_t* expand_heap(uint64_t bsize) {
+    uint64_t pages = (bsize + PMM_FRAME_SIZE - 1) / PMM_FRAME_SIZE;
+    if (heap_end + pages * PMM_FRAME_SIZE > VMM_KHEAP_BASE + VMM_KHEAP_SIZE) return NULL;
+    if (map_kernel_pages(heap_end, pages) != 0) return NULL;
     
-    // Allocate a new frame
-    void* new_frame = pmm_alloc_frame();
-    if (new_frame == NULL) {
-        return NULL;
+    heap_block_t* new_block = (heap_block_t*)(heap_end - HEAP_BLOCK_HEADER_SIZE);
+    heap_end += pages * PMM_FRAME_SIZE;
+    block_set(new_block, pages * PMM_FRAME_SIZE, 0);
+    heap_block_t* epilogue = block_next(new_block);
+    epilogue->size = 0;
+    epilogue->used = 1;
+    heap_block_t* b = heap_coalesce(new_block);
+    heap_bin_remove(b);
+    return b;
+}
+
+// Free block of at least 'bsize' bytes: first fit within the request's own bin (bounded
+// by the list length of one size class), else the head of the next non-empty bin, whose
+// blocks all fit. The block is taken out of its bin.
+static heap_block_t* heap_find(uint64_t bsize) {
+    unsigned bin = heap_bin(bsize);
+    for (heap_block_t* b = heap_bins[bin]; b; b = b->next_free) {
+        if (b->size >= bsize) { heap_bin_remove(b); return b; }
     }
-    
-    // Create a new block in the allocated frame
-    heap_block_t* new_block = (heap_block_t*)new_frame;
-    new_block->size = PMM_FRAME_SIZE - HEAP_BLOCK_HEADER_SIZE;
-    new_block->is_free = true;
-    new_block->next = NULL;
-    
-    current->next = new_block;
-    
-    return new_block;
+    uint32_t higher = bin + 1 < HEAP_BINS ? heap_bin_map & ~((2u << bin) - 1) : 0;
+    if (!higher) return NULL;
+    heap_block_t* b = heap_bins[__builtin_ctz(higher)];
+    heap_bin_remove(b);
+    return b;
 }
 
-// Allocate memory
-void* kmalloc(size_t size) {
-    // DEBUG
-    terminal_writestring("[kmalloc] Entry, size=");
-    char buf[16];
-    itoa_dec(size, buf);
-    terminal_writestring(buf);
-    terminal_writestring("\n");
-    
+static inline uint64_t heap_block_size(size_t size) {
+    uint64_t bsize = align_up(size + HEAP_BLOCK_OVERHEAD, 16);
+    return bsize < HEAP_MIN_BLOCK ? HEAP_MIN_BLOCK : bsize;
+}
+
+// Free block of at least 'bsize' bytes, out of its bin; the arena grows when none fits
+static heap_block_t* heap_get_block(uint64_t bsize) {
+    heap_block_t* block = heap_find(bsize);
+    if (!block) {
+        HEAP_DBG("[kmalloc] No free block, need to expand\n");
+        block = expand_heap(bsize);
+    }
+    if (!block) {
+        terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_RED, VGA_COLOR_BLACK));
+        terminal_writestring("[FAIL] Allocation failed (expand_heap NULL)\n");
+        terminal_setcolor(vga_entry_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK));
+    }
+    return block;
+}
+
+// Hand out the first 'bsize' bytes of a free block taken from its bin. The tail is split
+// off when it can hold a block of its own.
+static void* heap_carve(heap_block_t* block, uint64_t bsize) {
+    if (block->size - bsize >= HEAP_MIN_BLOCK) {
+        heap_block_t* tail = (heap_block_t*)((uint8_t*)block + bsize);
+        block_set(tail, block->size - bsize, 0);
+        heap_bin_insert(tail);
+        HEAP_DBG("[kmalloc] Block split\n");
+    } else {
+        bsize = block->size;
+    }
+    block_set(block, bsize, 1);
+    total_allocated += bsize - HEAP_BLOCK_OVERHEAD;
+    return (void*)((uint8_t*)block + HEAP_BLOCK_HEADER_SIZE);
+}
+
+// Allocate memory: slab classes up to SLAB_MAX_SIZE, boundary-tag arena up to a page,
+// vmalloc (whole pages + guard page) above. Heap metadata uses it directly, unprofiled.
+static void* heap_alloc(size_t size) {
     if (size == 0) {
-        terminal_writestring("[kmalloc] Size 0, return NULL\n");
+        HEAP_DBG("[kmalloc] Size 0, return NULL\n");
         return NULL;
     }
     
@@ -125,77 +568,168 @@ void* kmalloc(size_t size) {
         terminal_writestring("[kmalloc] heap_start is NULL!\n");
         return NULL;
     }
+
+    if (size <= SLAB_MAX_SIZE) return slab_alloc(&slab_classes[slab_index[(size + 7) / 8]]);
+    if (size >= PMM_FRAME_SIZE) return vmalloc_aligned(size, PMM_FRAME_SIZE);
     
-    terminal_writestring("[kmalloc] heap_start OK\n");
-    
-    // Align size to 8 bytes
-    size = align_up(size, 8);
-    
-    terminal_writestring("[kmalloc] Searching for free block...\n");
-    
-    heap_block_t* current = heap_start;
-    
-    // Search free block large enough (with potential splitting)
-    while (current != NULL) {
-        terminal_writestring("[kmalloc] Checking block\n");
-        if (current->is_free && current->size >= size) {
-            terminal_writestring("[kmalloc] Found free block!\n");
-            // If block is much larger, split it
-            size_t remaining = current->size - size;
-            if (remaining > HEAP_BLOCK_HEADER_SIZE + 16) {
-                // Perform split
-                uint8_t* new_addr = (uint8_t*)current + HEAP_BLOCK_HEADER_SIZE + size;
-                heap_block_t* new_block = (heap_block_t*)new_addr;
-                new_block->size = remaining - HEAP_BLOCK_HEADER_SIZE;
-                new_block->is_free = true;
-                new_block->next = current->next;
-                current->next = new_block;
-                current->size = size; // resize allocated block
-                terminal_writestring("[kmalloc] Block split\n");
-            }
-            current->is_free = false;
-            total_allocated += current->size;
-            terminal_writestring("[kmalloc] Returning pointer\n");
-            return (void*)((uint8_t*)current + HEAP_BLOCK_HEADER_SIZE);
-        }
-        current = current->next;
+    uint64_t bsize = heap_block_size(size);
+    heap_block_t* block = heap_get_block(bsize);
+    if (!block) return NULL;
+    return heap_carve(block, bsize);
+}
+
+// Allocate memory with alignment guarantee ('alignment': power of two). The pointer is
+// the start of a real object, so kfree() takes it like any other:
+//  - slab class whose objects fall on the alignment (up to the 64-byte slab header)
+//  - arena block carved at an aligned offset, leading fragment back to its bin (< 4KB)
+//  - vmalloc area placed on the alignment (page and larger, e.g. 2MB)
+static void* heap_alloc_aligned(size_t size, size_t alignment) {
+    if (size == 0 || alignment == 0 || (alignment & (alignment - 1))) return NULL;
+    if (heap_start == NULL) return NULL;
+    if (alignment <= 8) return heap_alloc(size);
+
+    size_t rounded = align_up(size, alignment);
+    if (rounded <= SLAB_MAX_SIZE && alignment <= SLAB_HDR_SIZE) {
+        unsigned c = slab_index[(rounded + 7) / 8];
+        if (slab_sizes[c] % alignment == 0) return slab_alloc(&slab_classes[c]);
     }
-    terminal_writestring("[kmalloc] No free block, need to expand\n");
-    // Try to expand the heap
-    heap_block_t* new_block = expand_heap(size);
-    if (!new_block) {
-        terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_RED, VGA_COLOR_BLACK));
-        terminal_writestring("[FAIL] Allocation failed (expand_heap NULL)\n");
-        terminal_setcolor(vga_entry_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK));
-        return NULL;
+    if (size >= PMM_FRAME_SIZE || alignment >= PMM_FRAME_SIZE) {
+        return vmalloc_aligned(size, alignment < PMM_FRAME_SIZE ? PMM_FRAME_SIZE : alignment);
+    }
+
+    // Room for the block plus the worst-case leading fragment, which is either empty or
+    // large enough to be a free block of its own
+    uint64_t bsize = heap_block_size(size);
+    heap_block_t* block = heap_get_block(bsize + alignment + HEAP_MIN_BLOCK);
+    if (!block) return NULL;
+    uint64_t payload = align_up((uint64_t)block + HEAP_BLOCK_HEADER_SIZE, alignment);
+    while (payload - HEAP_BLOCK_HEADER_SIZE - (uint64_t)block != 0 &&
+           payload - HEAP_BLOCK_HEADER_SIZE - (uint64_t)block < HEAP_MIN_BLOCK) {
+        payload += alignment;
     }
-    // Allocate from the new block (potential split if too large)
-    if (new_block->size > size + HEAP_BLOCK_HEADER_SIZE + 16) {
-        uint8_t* split_addr = (uint8_t*)new_block + HEAP_BLOCK_HEADER_SIZE + size;
-        heap_block_t* tail = (heap_block_t*)split_addr;
-        tail->size = new_block->size - size - HEAP_BLOCK_HEADER_SIZE;
-        tail->is_free = true;
-        tail->next = new_block->next;
-        new_block->next = tail;
-        new_block->size = size;
-        terminal_writestring("[kmalloc] Expanded and split new block\n");
+    uint64_t lead = payload - HEAP_BLOCK_HEADER_SIZE - (uint64_t)block;
+    if (lead) {
+        // Blocks in the bins are fully coalesced, so the fragment's left neighbour is used
+        heap_block_t* aligned = (heap_block_t*)(payload - HEAP_BLOCK_HEADER_SIZE);
+        block_set(aligned, block->size - lead, 0);
+        block_set(block, lead, 0);
+        heap_bin_insert(block);
+        block = aligned;
     }
-    new_block->is_free = false;
-    total_allocated += new_block->size;
-    return (void*)((uint8_t*)new_block + HEAP_BLOCK_HEADER_SIZE);
+    return heap_carve(block, bsize);
+}
+
+void* kmalloc(size_t size) {
+    void* ptr = heap_alloc(size);
+    HEAP_PROF_ALLOC(ptr, size);
+    return ptr;
 }
 
-// Allocate memory with alignment guarantee
 void* kmalloc_aligned(size_t size, size_t alignment) {
-    // Allocate extra space for alignment
-    void* ptr = kmalloc(size + alignment);
+    void* ptr = heap_alloc_aligned(size, alignment);
+    HEAP_PROF_ALLOC(ptr, size);
+    return ptr;
+}
+
+// Copy helper for krealloc (heap objects are at least 8-byte aligned)
+static void heap_copy_bytes(void* dst, const void* src, size_t n) {
+    uint64_t* d = (uint64_t*)dst;
+    const uint64_t* s = (const uint64_t*)src;
+    size_t words = n / 8;
+    for (size_t i = 0; i < words; i++) d[i] = s[i];
+    for (size_t i = words * 8; i < n; i++) ((uint8_t*)dst)[i] = ((const uint8_t*)src)[i];
+}
+
+// Resize an object, in place when possible:
+//  - slab object: still fits its class
+//  - arena block: shrinks by splitting off the tail, grows into a free right neighbour
+//  - vmalloc object: drops pages past the new end, or maps more when the gap to the next
+//    area leaves room for them and the guard page
+// Otherwise allocate, copy and free. Alignment from kmalloc_aligned() is not kept when
+// the object moves.
+void* krealloc(void* ptr, size_t size) {
     if (ptr == NULL) {
+        void* fresh = heap_alloc(size);
+        HEAP_PROF_ALLOC(fresh, size);
+        return fresh;
+    }
+    if (size == 0) {
+        kfree(ptr);
         return NULL;
     }
-    
-    // Align pointer
-    uint64_t aligned = align_up((uint64_t)ptr, alignment);
-    return (void*)aligned;
+
+    uint64_t addr = (uint64_t)ptr;
+    size_t old;
+    if (addr >= VMM_VMALLOC_BASE && addr < VMM_VMALLOC_BASE + VMM_VMALLOC_SIZE) {
+        vm_area_t* a = vm_areas;
+        while (a && a->start != addr) a = a->next;
+        if (!a) return NULL; // not the start of a vmalloc object
+        old = a->pages * PMM_FRAME_SIZE;
+        uint64_t pages = (size + PMM_FRAME_SIZE - 1) / PMM_FRAME_SIZE;
+        uint64_t limit = a->next ? a->next->start : VMM_VMALLOC_BASE + VMM_VMALLOC_SIZE;
+        if (pages <= a->pages) {
+            vmm_unmap_range(NULL, a->start + pages * PMM_FRAME_SIZE, a->pages - pages);
+            vm_mapped_pages -= a->pages - pages;
+            total_freed += (a->pages - pages) * PMM_FRAME_SIZE;
+            a->pages = pages;
+            HEAP_PROF_ALLOC(ptr, size);
+            return ptr;
+        }
+        if (a->start + (pages + 1) * PMM_FRAME_SIZE <= limit &&
+            map_kernel_pages(a->start + a->pages * PMM_FRAME_SIZE, pages - a->pages) == 0) {
+            vm_mapped_pages += pages - a->pages;
+            total_allocated += (pages - a->pages) * PMM_FRAME_SIZE;
+            a->pages = pages;
+            HEAP_PROF_ALLOC(ptr, size);
+            return ptr;
+        }
+    } else if (addr < VMM_KHEAP_BASE || addr >= heap_end) {
+        pmm_page_t* pg = pmm_page(virt_to_phys(addr));
+        if (!pg || !(pg->flags & PMM_PAGE_SLAB)) return NULL; // not a heap pointer
+        old = ((slab_t*)(addr & ~(uint64_t)(PMM_FRAME_SIZE - 1)))->cache->size;
+        if (size <= old) {
+            HEAP_PROF_ALLOC(ptr, size);
+            return ptr;
+        }
+    } else {
+        heap_block_t* block = (heap_block_t*)((uint8_t*)ptr - HEAP_BLOCK_HEADER_SIZE);
+        if (block->used != 1) return NULL;
+        old = block->size - HEAP_BLOCK_OVERHEAD;
+        uint64_t bsize = heap_block_size(size);
+        heap_block_t* next = block_next(block);
+        if (size < PMM_FRAME_SIZE && bsize <= block->size) {
+            if (block->size - bsize >= HEAP_MIN_BLOCK) {
+                heap_block_t* tail = (heap_block_t*)((uint8_t*)block + bsize);
+                block_set(tail, block->size - bsize, 0);
+                total_freed += block->size - bsize;
+                block_set(block, bsize, 1);
+                heap_coalesce(tail);
+            }
+            HEAP_PROF_ALLOC(ptr, size);
+            return ptr;
+        }
+        if (size < PMM_FRAME_SIZE && !next->used && block->size + next->size >= bsize) {
+            heap_bin_remove(next);
+            uint64_t whole = block->size + next->size;
+            if (whole - bsize < HEAP_MIN_BLOCK) bsize = whole;
+            total_allocated += bsize - block->size;
+            block_set(block, bsize, 1);
+            if (whole > bsize) {
+                heap_block_t* tail = (heap_block_t*)((uint8_t*)block + bsize);
+                block_set(tail, whole - bsize, 0);
+                heap_bin_insert(tail); // its right neighbour is used: 'next' was coalesced
+            }
+            HEAP_PROF_ALLOC(ptr, size);
+            return ptr;
+        }
+    }
+
+    void* moved = heap_alloc(size);
+    if (!moved) return NULL;
+    heap_copy_bytes(moved, ptr, old < size ? old : size);
+    kfree(ptr);
+    HEAP_PROF_ALLOC(moved, size);
+    return moved;
 }
 
 // Free memory
@@ -203,29 +737,27 @@ void kfree(void* ptr) {
     if (ptr == NULL) {
         return;
     }
+    HEAP_PROF_FREE(ptr);
+
+    uint64_t addr = (uint64_t)ptr;
+    if (addr >= VMM_VMALLOC_BASE && addr < VMM_VMALLOC_BASE + VMM_VMALLOC_SIZE) { vfree(ptr); return; }
+    if (addr < VMM_KHEAP_BASE || addr >= heap_end) {
+        pmm_page_t* pg = pmm_page(virt_to_phys(addr));
+        if (pg && (pg->flags & PMM_PAGE_SLAB)) slab_free(ptr);
+        return; // slab object or not a heap pointer
+    }
     
     // Get block header
     heap_block_t* block = (heap_block_t*)((uint8_t*)ptr - HEAP_BLOCK_HEADER_SIZE);
     
-    if (block->is_free) {
-        return;  // Already free
+    if (block->used != 1) {
+        return;  // Already free (or not a block start)
     }
     
-    block->is_free = true;
-    total_freed += block->size;
-    
-    // Coalesce adjacent free blocks
-    heap_block_t* current = heap_start;
-    
-    while (current != NULL && current->next != NULL) {
-        if (current->is_free && current->next->is_free) {
-            // Merge blocks
-            current->size += HEAP_BLOCK_HEADER_SIZE + current->next->size;
-            current->next = current->next->next;
-        } else {
-            current = current->next;
-        }
-    }
+    total_freed += block->size - HEAP_BLOCK_OVERHEAD;
+    block->used = 0;
+    // O(1) merge with both neighbours through the boundary tags
+    heap_coalesce(block);
 }
 
 // Print heap allocator statistics
@@ -249,5 +781,169 @@ void heap_print_stats(void) {
     terminal_writestring("In use:     ");
     itoa_dec(total_allocated - total_freed, buffer);
     terminal_writestring(buffer);
-    terminal_writestring(" bytes\n\n");
-}
\ No newline at end of file
+    terminal_writestring(" bytes\n");
+
+    terminal_writestring("Arena:      ");
+    itoa_dec((heap_end - VMM_KHEAP_BASE) / 1024, buffer);
+    terminal_writestring(buffer);
+    terminal_writestring(" KB mapped, ");
+    itoa_dec(heap_free_blocks, buffer);
+    terminal_writestring(buffer);
+    terminal_writestring(" free blocks (");
+    itoa_dec(heap_free_bytes, buffer);
+    terminal_writestring(buffer);
+    terminal_writestring(" bytes)\n");
+
+    terminal_writestring("vmalloc:    ");
+    itoa_dec(vm_area_count, buffer);
+    terminal_writestring(buffer);
+    terminal_writestring(" objects, ");
+    itoa_dec(vm_mapped_pages, buffer);
+    terminal_writestring(buffer);
+    terminal_writestring(" pages\n");
+
+    // Per class: objects in use / capacity of its slabs, slab frames, alloc/free counts
+    terminal_writestring("Slab classes (size: inuse/capacity slabs allocs frees):\n");
+    for (unsigned c = 0; c < SLAB_CLASSES; c++) {
+        const kmem_cache_t* sc = &slab_classes[c];
+        if (!sc->slabs && !sc->allocs) continue;
+        terminal_writestring("  ");
+        itoa_dec(slab_sizes[c], buffer); terminal_writestring(buffer);
+        terminal_writestring(" B: ");
+        itoa_dec(sc->inuse, buffer); terminal_writestring(buffer);
+        terminal_writestring("/");
+        itoa_dec(sc->slabs * ((PMM_FRAME_SIZE - SLAB_HDR_SIZE) / slab_sizes[c]), buffer); terminal_writestring(buffer);
+        terminal_writestring(" slabs="); itoa_dec(sc->slabs, buffer); terminal_writestring(buffer);
+        terminal_writestring(" allocs="); itoa_dec(sc->allocs, buffer); terminal_writestring(buffer);
+        terminal_writestring(" frees="); itoa_dec(sc->frees, buffer); terminal_writestring(buffer);
+        terminal_writestring("\n");
+    }
+    if (kmem_caches) terminal_writestring("Object caches (name size: inuse/capacity slabs allocs frees):\n");
+    for (const kmem_cache_t* sc = kmem_caches; sc; sc = sc->next) {
+        terminal_writestring("  ");
+        terminal_writestring(sc->name);
+        terminal_writestring(" ");
+        itoa_dec(sc->size, buffer); terminal_writestring(buffer);
+        terminal_writestring(" B: ");
+        itoa_dec(sc->inuse, buffer); terminal_writestring(buffer);
+        terminal_writestring("/");
+        itoa_dec(sc->slabs * ((PMM_FRAME_SIZE - SLAB_HDR_SIZE) / sc->size), buffer); terminal_writestring(buffer);
+        terminal_writestring(" slabs="); itoa_dec(sc->slabs, buffer); terminal_writestring(buffer);
+        terminal_writestring(" allocs="); itoa_dec(sc->allocs, buffer); terminal_writestring(buffer);
+        terminal_writestring(" frees="); itoa_dec(sc->frees, buffer); terminal_writestring(buffer);
+        terminal_writestring("\n");
+    }
+    terminal_writestring("\n");
+}
+
+#if ENABLE_HEAP_PROFILE
+uint32_t heap_prof_set_owner(uint32_t pid) {
+    uint32_t prev = prof_owner;
+    prof_owner = pid;
+    return prev;
+}
+
+// Mark what the process still owns: from now on those records are leaks
+void heap_prof_owner_exit(uint32_t pid) {
+    for (uint32_t i = 0; i < HEAP_PROF_SLOTS; i++) {
+        if (prof_tab[i].ptr && prof_tab[i].owner == pid) prof_tab[i].owner |= HEAP_PROF_ORPHAN;
+    }
+}
+
+typedef struct heap_prof_site {
+    uint64_t site;
+    uint64_t bytes;
+    uint64_t count;
+} heap_prof_site_t;
+
+static heap_prof_site_t prof_sites[HEAP_PROF_SITES];
+
+// Print the 'top' sites with the largest key (bytes or count), selection without sorting
+static void heap_prof_print_top(unsigned nsites, int by_count, unsigned top) {
+    char buffer[32];
+    uint8_t shown[HEAP_PROF_SITES] = {0};
+    for (unsigned k = 0; k < top && k < nsites; k++) {
+        int best = -1;
+        for (unsigned s = 0; s < nsites; s++) {
+            if (shown[s]) continue;
+            uint64_t key = by_count ? prof_sites[s].count : prof_sites[s].bytes;
+            uint64_t best_key = best < 0 ? 0 : (by_count ? prof_sites[best].count : prof_sites[best].bytes);
+            if (best < 0 || key > best_key) best = (int)s;
+        }
+        shown[best] = 1;
+        terminal_writestring("  ");
+        print_hex(prof_sites[best].site);
+        terminal_writestring("  bytes=");
+        itoa_dec(prof_sites[best].bytes, buffer); terminal_writestring(buffer);
+        terminal_writestring(" count=");
+        itoa_dec(prof_sites[best].count, buffer); terminal_writestring(buffer);
+        terminal_writestring("\n");
+    }
+}
+
+void heap_prof_report(void) {
+    char buffer[32];
+    unsigned nsites = 0;
+    uint64_t other_bytes = 0, other_count = 0, orphans = 0, orphan_bytes = 0;
+    for (uint32_t i = 0; i < HEAP_PROF_SLOTS; i++) {
+        const heap_prof_rec_t* r = &prof_tab[i];
+        if (!r->ptr) continue;
+        if (r->owner & HEAP_PROF_ORPHAN) { orphans++; orphan_bytes += r->size; }
+        unsigned s = 0;
+        while (s < nsites && prof_sites[s].site != r->site) s++;
+        if (s == nsites) {
+            if (nsites == HEAP_PROF_SITES) { other_bytes += r->size; other_count++; continue; }
+            prof_sites[nsites].site = r->site;
+            prof_sites[nsites].bytes = prof_sites[nsites].count = 0;
+            nsites++;
+        }
+        prof_sites[s].bytes += r->size;
+        prof_sites[s].count++;
+    }
+
+    terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_CYAN, VGA_COLOR_BLACK));
+    terminal_writestring("\n=== Heap Profile ===\n");
+    terminal_setcolor(vga_entry_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK));
+    terminal_writestring("Live allocations: ");
+    itoa_dec(prof_live, buffer); terminal_writestring(buffer);
+    terminal_writestring(" from ");
+    itoa_dec(nsites, buffer); terminal_writestring(buffer);
+    terminal_writestring(" call sites, dropped: ");
+    itoa_dec(prof_dropped, buffer); terminal_writestring(buffer);
+    terminal_writestring("\n");
+    if (other_count) {
+        terminal_writestring("Sites over table limit: ");
+        itoa_dec(other_count, buffer); terminal_writestring(buffer);
+        terminal_writestring(" allocations, ");
+        itoa_dec(other_bytes, buffer); terminal_writestring(buffer);
+        terminal_writestring(" bytes\n");
+    }
+    terminal_writestring("Top call sites by bytes:\n");
+    heap_prof_print_top(nsites, 0, 8);
+    terminal_writestring("Top call sites by count:\n");
+    heap_prof_print_top(nsites, 1, 8);
+
+    // Leaks: allocations made on behalf of a process that outlived process_destroy()
+    terminal_writestring("Survived process_destroy(): ");
+    itoa_dec(orphans, buffer); terminal_writestring(buffer);
+    terminal_writestring(" objects, ");
+    itoa_dec(orphan_bytes, buffer); terminal_writestring(buffer);
+    terminal_writestring(" bytes\n");
+    unsigned listed = 0;
+    for (uint32_t i = 0; i < HEAP_PROF_SLOTS && listed < 16; i++) {
+        const heap_prof_rec_t* r = &prof_tab[i];
+        if (!r->ptr || !(r->owner & HEAP_PROF_ORPHAN)) continue;
+        terminal_writestring("  pid=");
+        itoa_dec(r->owner & ~HEAP_PROF_ORPHAN, buffer); terminal_writestring(buffer);
+        terminal_writestring(" ptr=");
+        print_hex(r->ptr);
+        terminal_writestring(" size=");
+        itoa_dec(r->size, buffer); terminal_writestring(buffer);
+        terminal_writestring(" site=");
+        print_hex(r->site);
+        terminal_writestring("\n");
+        listed++;
+    }
+    terminal_writestring("\n");
+}
+#endif
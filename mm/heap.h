@@ -8,6 +8,7 @@
  */
 #include <stdint.h>
 #include <stddef.h>
+#include "config.h" // ENABLE_HEAP_PROFILE
 
 // Initialize heap allocator
 void heap_init(void);
@@ -15,13 +16,44 @@ void heap_init(void);
 // Allocate dynamic memory
 void* kmalloc(size_t size);
 
-// Allocate memory with specified alignment
+// Allocate memory with specified alignment (power of two, e.g. 64, 4096, 2MB). The
+// result is released with kfree() like any other heap pointer.
 void* kmalloc_aligned(size_t size, size_t alignment);
 
+// Resize an allocation (in place when the block can grow or shrink where it is, else
+// allocate + copy + free). NULL ptr = kmalloc, size 0 = kfree. On failure the old
+// object is left untouched and NULL is returned.
+void* krealloc(void* ptr, size_t size);
+
 // Free previously allocated memory
 void kfree(void* ptr);
 
+// Virtually contiguous whole-page allocation in the vmalloc area (VMM_VMALLOC_BASE), each
+// object followed by an unmapped guard page. kmalloc() uses it for sizes >= 4KB.
+void* vmalloc(size_t size);
+void vfree(void* ptr);
+
+// Typed object caches: fixed-size objects from dedicated slabs (one frame each, objects
+// up to 4032 bytes, alignment up to 64). The optional constructor runs once per object
+// when its slab is created, so objects must be freed back in their constructed state.
+// kfree() also accepts cache objects.
+typedef struct kmem_cache kmem_cache_t;
+kmem_cache_t* kmem_cache_create(const char* name, size_t size, size_t align, void (*ctor)(void*));
+void* kmem_cache_alloc(kmem_cache_t* cache);
+void kmem_cache_free(kmem_cache_t* cache, void* obj);
+
 // Print heap statistics
 void heap_print_stats(void);
 
+// Allocation profiler (ENABLE_HEAP_PROFILE): live allocations by call site and objects
+// that outlive the process they were allocated for. Compiled out entirely when disabled.
+#if ENABLE_HEAP_PROFILE
+uint32_t heap_prof_set_owner(uint32_t pid); // attribute next allocations to pid, returns previous
+void heap_prof_owner_exit(uint32_t pid);    // pid destroyed: what it still owns is leaked
+void heap_prof_report(void);
+#else
+static inline uint32_t heap_prof_set_owner(uint32_t pid) { (void)pid; return 0; }
+static inline void heap_prof_owner_exit(uint32_t pid) { (void)pid; }
+#endif
+
 #endif
\ No newline at end of file
@@ -5,53 +5,400 @@
  * SPDX-License-Identifier: MIT
  */
 #include "pmm.h"
+#include "config.h" // PMM_USE_BUDDY
+#include "vmm.h" // phys_to_virt for frames above the identity map
 #include "multiboot.h"
 #include "multiboot2.h"
 #include "terminal.h"
+#include "timer.h" // timer_rdtsc for init timing
 // print_hex definita in kernel, forward decl per debug
 extern void print_hex(uint64_t value);
 
-// Bitmap tracking free/used physical frames
-static uint32_t* frame_bitmap = NULL;
-static uint64_t total_frames = 0;
-static uint64_t used_frames = 0;
+// Sparse frame tracking: physical memory is split in 128MB sections and metadata
+// (bitmap + struct page array) exists only for sections that contain RAM, so its size
+// follows populated memory instead of the highest physical address.
+#define PMM_SECTION_SHIFT   27                                  // 128MB per section
+#define PMM_SECTION_FRAMES  (1ULL << (PMM_SECTION_SHIFT - 12))  // 32768 frames
+#define PMM_MAX_SECTIONS    (PMM_MAX_PHYS >> PMM_SECTION_SHIFT)
+#define PMM_MAX_REGIONS     128
+
+// Bitmap words are 64-bit; a summary bit per group of 4096 frames (64 words) says
+// "this group may contain a free frame", so searches skip full groups without reading them.
+#define PMM_GROUP_FRAMES    4096
+#define PMM_GROUP_WORDS     (PMM_GROUP_FRAMES / 64)
+#define PMM_SECTION_GROUPS  (PMM_SECTION_FRAMES / PMM_GROUP_FRAMES)  // 8 -> fits uint8_t
+
+typedef struct pmm_section {
+    uint64_t* bitmap;      // 1 bit per frame (1 = used / not RAM)
+    pmm_page_t* pages;     // per frame descriptor (refcount, flags, owner, buddy order)
+    uint64_t  ram_frames;  // frames of this section handed to the allocator
+    uint8_t   summary;     // bit g set = group g may have a free frame (cleared lazily)
+} pmm_section_t;
+
+#define PMM_SECTION_META_SIZE (sizeof(pmm_section_t) + PMM_SECTION_FRAMES / 8 + PMM_SECTION_FRAMES * sizeof(pmm_page_t))
+
+static pmm_section_t* sections[PMM_MAX_SECTIONS];
+static uint64_t present_sections = 0;
+static uint64_t meta_bytes = 0;         // memory spent on section metadata
+static uint64_t max_pfn = 0;            // one past the highest tracked frame
+static uint64_t usable_frames = 0;      // RAM frames tracked by the allocator
+static uint64_t free_frames = 0;        // frames currently sitting in buddy free lists
+static uint64_t reserved_end_frame = 0; // [0, reserved_end_frame) = low memory + kernel + early metadata
 static uint64_t total_memory = 0;
 static uint64_t max_phys_addr_seen = 0;
+static int physmap_ready = 0;           // frames reached through the physmap once set
+static pmm_deferred_stats_t deferred_stats;
+
+// Simple structure for available memory regions gathered from loader
+struct avail_region { uint64_t addr; uint64_t len; };
+static struct avail_region saved_regions[PMM_MAX_REGIONS]; // kept for pmm_init_highmem
+static int saved_region_count = 0;
+
+// Zones: physical memory is split by address so that consumers with addressing limits
+// (ISA DMA, identity-mapped kernel structures, 32-bit DMA) are not starved by plain
+// allocations. Each zone has its own free structures and counters. A request names the
+// highest zone it accepts and falls back to lower zones only while they stay above their
+// watermark, so the reserve is kept for requests that can only be served there.
+// Zone boundaries are multiples of 16MB: buddy blocks (<= 4MB) and bitmap groups (16MB)
+// never cross them.
+#define PMM_ORDER_NONE  0xFF        // frame is not the head of a free block
+#define PMM_PFN_NONE    ((uint64_t)-1)
+#define PMM_LOW_PFN_LIMIT (PMM_IDENTITY_LIMIT / PMM_FRAME_SIZE)
+
+typedef struct pmm_free_block {
+    uint64_t next;
+    uint64_t prev;
+} pmm_free_block_t;
+
+typedef struct pmm_free_list {
+    uint64_t head;
+    uint64_t count;
+} pmm_free_list_t;
+
+typedef struct pmm_zone {
+    const char* name;
+    uint64_t start_pfn, end_pfn;                  // [start, end)
+    pmm_free_list_t free_area[PMM_MAX_ORDER + 1]; // buddy lists (buddy mode)
+    uint64_t hint;                                // next-fit hint (bitmap mode)
+    uint64_t managed_frames;                      // frames handed to this zone
+    uint64_t free_frames;
+    uint64_t watermark;                           // reserve kept from fallback requests
+    uint64_t fallback_allocs;                     // blocks served for a higher zone
+} pmm_zone_t;
+
+static pmm_zone_t zones[PMM_ZONE_COUNT] = {
+    { "DMA",    0,                                   PMM_ZONE_DMA_LIMIT / PMM_FRAME_SIZE,   {{0,0}}, 0,0,0,0,0 },
+    { "LOW",    PMM_ZONE_DMA_LIMIT / PMM_FRAME_SIZE, PMM_IDENTITY_LIMIT / PMM_FRAME_SIZE,   {{0,0}}, 0,0,0,0,0 },
+    { "DMA32",  PMM_IDENTITY_LIMIT / PMM_FRAME_SIZE, PMM_ZONE_DMA32_LIMIT / PMM_FRAME_SIZE, {{0,0}}, 0,0,0,0,0 },
+    { "NORMAL", PMM_ZONE_DMA32_LIMIT / PMM_FRAME_SIZE, PMM_MAX_PHYS / PMM_FRAME_SIZE,       {{0,0}}, 0,0,0,0,0 },
+};
+
+static inline pmm_zone_t* zone_of(uint64_t pfn) {
+    if (pfn >= zones[PMM_ZONE_NORMAL].start_pfn) return &zones[PMM_ZONE_NORMAL];
+    if (pfn >= zones[PMM_ZONE_DMA32].start_pfn) return &zones[PMM_ZONE_DMA32];
+    if (pfn >= zones[PMM_ZONE_LOW].start_pfn) return &zones[PMM_ZONE_LOW];
+    return &zones[PMM_ZONE_DMA];
+}
+
+// A fallback request may take n frames from zone z only above its watermark
+static inline bool zone_can_fallback(const pmm_zone_t* z, uint64_t n) {
+    return z->free_frames >= z->watermark + n;
+}
 
 // Kernel end position (defined in linker script)
 extern uint32_t _kernel_end;
 
-// Helper: set a bit in bitmap
-static inline void bitmap_set(uint32_t frame) {
-    uint32_t idx = frame / 32;
-    uint32_t bit = frame % 32;
-    frame_bitmap[idx] |= (1 << bit);
+static inline pmm_section_t* section_of(uint64_t pfn) {
+    uint64_t s = pfn >> (PMM_SECTION_SHIFT - 12);
+    return (s < PMM_MAX_SECTIONS) ? sections[s] : NULL;
+}
+
+static inline uint64_t section_offset(uint64_t pfn) {
+    return pfn & (PMM_SECTION_FRAMES - 1);
 }
 
-// Helper: clear a bit in bitmap
-static inline void bitmap_clear(uint32_t frame) {
-    uint32_t idx = frame / 32;
-    uint32_t bit = frame % 32;
-    frame_bitmap[idx] &= ~(1 << bit);
+// Helper: mark a frame allocated (bitmap bit + fresh descriptor with one reference)
+static inline void frame_set_used(uint64_t frame) {
+    uint64_t off = section_offset(frame);
+    pmm_section_t* s = section_of(frame);
+    s->bitmap[off / 64] |= (1ULL << (off % 64));
+    s->pages[off].refcount = 1;
+    s->pages[off].flags = 0;
+    s->pages[off].owner = 0;
+}
+
+// Helper: mark a frame free (and flag the group in the summary)
+static inline void frame_set_free(uint64_t frame) {
+    uint64_t off = section_offset(frame);
+    pmm_section_t* s = section_of(frame);
+    s->bitmap[off / 64] &= ~(1ULL << (off % 64));
+    s->summary |= (uint8_t)(1u << (off / PMM_GROUP_FRAMES));
+    s->pages[off].refcount = 0;
+    s->pages[off].flags = 0;
+    s->pages[off].owner = 0;
 }
 
 // Helper: test a bit in bitmap
-static inline bool bitmap_test(uint32_t frame) {
-    uint32_t idx = frame / 32;
-    uint32_t bit = frame % 32;
-    return (frame_bitmap[idx] & (1 << bit)) != 0;
+static inline bool bitmap_test(uint64_t frame) {
+    uint64_t off = section_offset(frame);
+    return (section_of(frame)->bitmap[off / 64] & (1ULL << (off % 64))) != 0;
+}
+
+static inline uint8_t order_get(uint64_t frame) {
+    return section_of(frame)->pages[section_offset(frame)].order;
+}
+
+static inline void order_set(uint64_t frame, uint8_t order) {
+    section_of(frame)->pages[section_offset(frame)].order = order;
+}
+
+// Frame is tracked by a present section and may be handed out / freed
+static inline bool pfn_managed(uint64_t pfn) {
+    return pfn >= reserved_end_frame && pfn < max_pfn && section_of(pfn) != NULL;
+}
+
+// Kernel pointer to a physical address: identity map during early boot, physmap afterwards
+static inline void* pmm_phys_ptr(uint64_t phys) {
+    return physmap_ready ? (void*)phys_to_virt(phys) : (void*)phys;
+}
+
+// Free block header stored at the start of the block
+static inline pmm_free_block_t* block_at(uint64_t frame) {
+    return (pmm_free_block_t*)pmm_phys_ptr(frame * PMM_FRAME_SIZE);
+}
+
+#if PMM_USE_BUDDY
+static void free_list_push(pmm_zone_t* z, uint64_t frame, unsigned order) {
+    pmm_free_list_t* l = &z->free_area[order];
+    pmm_free_block_t* b = block_at(frame);
+    b->prev = PMM_PFN_NONE;
+    b->next = l->head;
+    if (l->head != PMM_PFN_NONE) block_at(l->head)->prev = frame;
+    l->head = frame;
+    l->count++;
+    order_set(frame, (uint8_t)order);
+}
+
+static void free_list_remove(pmm_zone_t* z, uint64_t frame, unsigned order) {
+    pmm_free_list_t* l = &z->free_area[order];
+    pmm_free_block_t* b = block_at(frame);
+    if (b->prev != PMM_PFN_NONE) block_at(b->prev)->next = b->next; else l->head = b->next;
+    if (b->next != PMM_PFN_NONE) block_at(b->next)->prev = b->prev;
+    l->count--;
+    order_set(frame, PMM_ORDER_NONE);
+}
+
+// Take a block of exactly 'order' frames from one zone, splitting a larger one if needed
+static uint64_t zone_buddy_alloc(pmm_zone_t* z, unsigned order) {
+    unsigned o = order;
+    while (o <= PMM_MAX_ORDER && z->free_area[o].head == PMM_PFN_NONE) o++;
+    if (o > PMM_MAX_ORDER) return PMM_PFN_NONE;
+    uint64_t frame = z->free_area[o].head;
+    free_list_remove(z, frame, o);
+    // Return upper halves to the lower orders
+    while (o > order) {
+        o--;
+        free_list_push(z, frame + (1ULL << o), o);
+    }
+    return frame;
+}
+
+// Allocate 2^order frames from zone 'zone' or, above their watermark, lower zones.
+// O(PMM_ZONE_COUNT * PMM_MAX_ORDER).
+static uint64_t buddy_alloc(unsigned order, int zone) {
+    uint64_t n = 1ULL << order;
+    for (int zi = zone; zi >= 0; zi--) {
+        pmm_zone_t* z = &zones[zi];
+        if (zi != zone && !zone_can_fallback(z, n)) continue;
+        uint64_t frame = zone_buddy_alloc(z, order);
+        if (frame == PMM_PFN_NONE) continue;
+        if (zi != zone) z->fallback_allocs++;
+        for (uint64_t f = frame; f < frame + n; f++) frame_set_used(f);
+        z->free_frames -= n;
+        free_frames -= n;
+        return frame;
+    }
+    return PMM_PFN_NONE;
+}
+
+// Release a block and merge it with its free buddies. O(PMM_MAX_ORDER).
+// Blocks never cross a section or a zone (both are aligned to the max order).
+static void buddy_free(uint64_t frame, unsigned order) {
+    uint64_t n = 1ULL << order;
+    pmm_zone_t* z = zone_of(frame);
+    for (uint64_t f = frame; f < frame + n; f++) frame_set_free(f);
+    z->free_frames += n;
+    free_frames += n;
+    while (order < PMM_MAX_ORDER) {
+        uint64_t buddy = frame ^ (1ULL << order);
+        if (order_get(buddy) != order) break; // buddy busy or split
+        free_list_remove(z, buddy, order);
+        if (buddy < frame) frame = buddy;
+        order++;
+    }
+    free_list_push(z, frame, order);
+}
+
+// Hand a frame range to the buddy lists using the largest naturally aligned blocks
+static void buddy_free_range(uint64_t start, uint64_t end) {
+    while (start < end) {
+        unsigned order = PMM_MAX_ORDER;
+        while (order > 0 && ((start & ((1ULL << order) - 1)) || start + (1ULL << order) > end)) order--;
+        uint64_t n = 1ULL << order;
+        // Overlapping loader regions: fall back to single frames for already-free parts
+        bool all_used = true;
+        for (uint64_t f = start; f < start + n; f++) if (!bitmap_test(f)) { all_used = false; break; }
+        if (!all_used) {
+            if (bitmap_test(start)) buddy_free(start, 0);
+            start++;
+            continue;
+        }
+        // Blocks enter through buddy_free so adjacent ranges coalesce
+        buddy_free(start, order);
+        start += n;
+    }
+}
+
+#define frames_alloc_raw  buddy_alloc
+#define frames_free       buddy_free
+#define frames_free_range buddy_free_range
+#else // !PMM_USE_BUDDY
+
+// Summary bitmap allocator: frames are found with a tzcnt/bsf scan of 64-bit words,
+// skipping 4096-frame groups whose summary bit is clear. A rotating next-fit hint per
+// zone starts each search where the last one succeeded.
+// First aligned run of 2^order free frames inside one group (runs never cross a group:
+// PMM_MAX_ORDER blocks are 1024 frames). Returns the offset in the section or -1.
+static int64_t group_find(pmm_section_t* s, unsigned g, unsigned order) {
+    uint64_t* w = s->bitmap + (uint64_t)g * PMM_GROUP_WORDS;
+    uint64_t n = 1ULL << order;
+    if (n >= 64) {
+        uint64_t k = n / 64;
+        for (uint64_t i = 0; i < PMM_GROUP_WORDS; i += k) {
+            uint64_t j = 0;
+            while (j < k && w[i + j] == 0) j++;
+            if (j == k) return (int64_t)((uint64_t)g * PMM_GROUP_FRAMES + i * 64);
+        }
+        return -1;
+    }
+    uint64_t mask = (1ULL << n) - 1;
+    for (uint64_t i = 0; i < PMM_GROUP_WORDS; i++) {
+        uint64_t free_bits = ~w[i];
+        if (!free_bits) continue;
+        if (n == 1) return (int64_t)((uint64_t)g * PMM_GROUP_FRAMES + i * 64 + (uint64_t)__builtin_ctzll(free_bits));
+        for (uint64_t b = 0; b < 64; b += n) {
+            if (((w[i] >> b) & mask) == 0) return (int64_t)((uint64_t)g * PMM_GROUP_FRAMES + i * 64 + b);
+        }
+    }
+    return -1;
 }
 
-// Find first free frame
-static uint32_t find_free_frame(void) {
-    for (uint32_t i = 0; i < total_frames; i++) {
-        if (!bitmap_test(i)) {
-            return i;
+// Search the groups of one zone starting at the group holding its hint, wrapping once
+static uint64_t bitmap_search(pmm_zone_t* z, unsigned order) {
+    uint64_t end_pfn = z->end_pfn < max_pfn ? z->end_pfn : max_pfn;
+    if (z->start_pfn >= end_pfn) return PMM_PFN_NONE;
+    uint64_t g_lo = z->start_pfn / PMM_GROUP_FRAMES;
+    uint64_t g_hi = (end_pfn + PMM_GROUP_FRAMES - 1) / PMM_GROUP_FRAMES;
+    uint64_t total_groups = g_hi - g_lo;
+    uint64_t start = z->hint / PMM_GROUP_FRAMES;
+    if (start < g_lo || start >= g_hi) start = g_lo;
+    for (uint64_t i = 0; i < total_groups; i++) {
+        uint64_t gi = start + i;
+        if (gi >= g_hi) gi -= total_groups;
+        pmm_section_t* s = sections[gi / PMM_SECTION_GROUPS];
+        if (!s || !s->summary) continue;
+        unsigned g = (unsigned)(gi % PMM_SECTION_GROUPS);
+        if (!(s->summary & (1u << g))) continue;
+        int64_t off = group_find(s, g, order);
+        if (off < 0) {
+            if (order == 0) s->summary &= (uint8_t)~(1u << g); // group full: drop the summary bit
+            continue;
         }
+        uint64_t frame = (gi / PMM_SECTION_GROUPS) * PMM_SECTION_FRAMES + (uint64_t)off;
+        z->hint = frame;
+        return frame;
     }
-    return (uint32_t)-1;
+    return PMM_PFN_NONE;
 }
 
+// Same contract as buddy_alloc: 2^order frames aligned to 2^order, zone fallback order
+static uint64_t bitmap_alloc(unsigned order, int zone) {
+    uint64_t n = 1ULL << order;
+    for (int zi = zone; zi >= 0; zi--) {
+        pmm_zone_t* z = &zones[zi];
+        if (zi != zone && !zone_can_fallback(z, n)) continue;
+        if (!z->free_frames) continue;
+        uint64_t frame = bitmap_search(z, order);
+        if (frame == PMM_PFN_NONE) continue;
+        if (zi != zone) z->fallback_allocs++;
+        for (uint64_t f = frame; f < frame + n; f++) frame_set_used(f);
+        z->free_frames -= n;
+        free_frames -= n;
+        return frame;
+    }
+    return PMM_PFN_NONE;
+}
+
+static void bitmap_free_range(uint64_t start, uint64_t end) {
+    for (uint64_t f = start; f < end; f++) {
+        if (!bitmap_test(f)) continue; // already free (overlapping loader regions)
+        frame_set_free(f);
+        zone_of(f)->free_frames++;
+        free_frames++;
+    }
+}
+
+static void bitmap_free_block(uint64_t frame, unsigned order) {
+    bitmap_free_range(frame, frame + (1ULL << order));
+}
+
+#define frames_alloc_raw  bitmap_alloc
+#define frames_free       bitmap_free_block
+#define frames_free_range bitmap_free_range
+#endif // PMM_USE_BUDDY
+
+#if PMM_DEFERRED_INIT
+// Deferred init: at boot only sections below PMM_IDENTITY_LIMIT get metadata and free
+// structures. Higher sections with RAM are only recorded here and set up one at a time,
+// by the first allocation that needs them or from the idle loop (pmm_deferred_init_idle),
+// so boot time does not grow with installed memory.
+static uint64_t deferred_map[PMM_MAX_SECTIONS / 64]; // bit = section has RAM, not set up yet
+static bool deferred_busy = false;                   // section init in progress (no recursion)
+static bool deferred_grow(int zone_hi, int zone_lo);
+
+// Zone can hand out a 2^order block by itself, without fallback
+static inline bool zone_can_serve(const pmm_zone_t* z, unsigned order) {
+#if PMM_USE_BUDDY
+    for (unsigned o = order; o <= PMM_MAX_ORDER; o++) if (z->free_area[o].head != PMM_PFN_NONE) return true;
+    return false;
+#else
+    return z->free_frames >= (1ULL << order);
+#endif
+}
+
+// Zone zi can take the request the way frames_alloc_raw would (fallback: above watermark)
+static inline bool zone_ready(int zi, int zone, unsigned order) {
+    return zone_can_serve(&zones[zi], order) && (zi == zone || zone_can_fallback(&zones[zi], 1ULL << order));
+}
+
+// Allocation entry point: walking down from the requested zone, pending sections of each
+// zone are set up until it can serve the request, stopping at the first zone that can.
+// frames_alloc_raw then takes exactly that zone and never falls back past a higher zone
+// whose RAM is only pending. Any zone is grown further only if the allocation still fails.
+static uint64_t frames_alloc(unsigned order, int zone) {
+    if (deferred_busy || !deferred_stats.pending_sections) return frames_alloc_raw(order, zone);
+    for (int zi = zone; zi >= 0; zi--) {
+        while (!zone_ready(zi, zone, order) && deferred_grow(zi, zi)) { }
+        if (zone_ready(zi, zone, order)) break;
+    }
+    uint64_t frame = frames_alloc_raw(order, zone);
+    while (frame == PMM_PFN_NONE && deferred_grow(zone, 0)) frame = frames_alloc_raw(order, zone);
+    return frame;
+}
+#else
+#define frames_alloc      frames_alloc_raw
+#endif
+
 // Convert number to decimal string
 static void itoa_dec(uint64_t value, char* buffer) {
     if (value == 0) {
@@ -75,85 +422,289 @@ static void itoa_dec(uint64_t value, char* buffer) {
     buffer[j] = '\0';
 }
 
-// Simple structure for available memory regions gathered from loader
-struct avail_region { uint64_t addr; uint64_t len; };
+// Set up an empty section (all frames used, no free block heads) in the given metadata area
+static pmm_section_t* section_setup(uint64_t sec, uint8_t* meta) {
+    pmm_section_t* s = (pmm_section_t*)meta;
+    s->bitmap = (uint64_t*)(meta + sizeof(pmm_section_t));
+    s->pages = (pmm_page_t*)((uint8_t*)s->bitmap + PMM_SECTION_FRAMES / 8);
+    s->ram_frames = 0;
+    s->summary = 0;
+    for (uint64_t i = 0; i < PMM_SECTION_FRAMES / 64; i++) s->bitmap[i] = ~0ULL;
+    for (uint64_t i = 0; i < PMM_SECTION_FRAMES; i++) {
+        // Holes and reserved frames: one permanent reference, never handed out
+        s->pages[i].refcount = 1;
+        s->pages[i].flags = PMM_PAGE_RESERVED;
+        s->pages[i].order = PMM_ORDER_NONE;
+        s->pages[i].owner = 0;
+    }
+    sections[sec] = s;
+    present_sections++;
+    meta_bytes += PMM_SECTION_META_SIZE;
+    return s;
+}
+
+// Count frames [start, end) as managed by the zones they fall in
+static void zones_add_managed(uint64_t start, uint64_t end) {
+    for (int zi = 0; zi < PMM_ZONE_COUNT; zi++) {
+        uint64_t a = start > zones[zi].start_pfn ? start : zones[zi].start_pfn;
+        uint64_t b = end < zones[zi].end_pfn ? end : zones[zi].end_pfn;
+        if (a < b) zones[zi].managed_frames += b - a;
+    }
+}
+
+// Reserve kept from fallback requests, as a fraction of each zone (shift): DMA keeps half
+// for ISA-style devices, LOW 1/16 for page tables, heap and IST stacks, DMA32 1/64.
+static const unsigned zone_watermark_shift[PMM_ZONE_COUNT] = { 1, 4, 6, 0 };
+
+static void zones_update_watermarks(void) {
+    for (int zi = 0; zi < PMM_ZONE_COUNT; zi++) {
+        unsigned sh = zone_watermark_shift[zi];
+        zones[zi].watermark = sh ? (zones[zi].managed_frames >> sh) : 0;
+    }
+}
+
+// Add the part of every saved region that falls in [lo, hi) frames to the allocator
+static void pmm_add_regions(uint64_t lo, uint64_t hi) {
+    for (int r=0;r<saved_region_count;r++) {
+        uint64_t start_frame = (saved_regions[r].addr + PMM_FRAME_SIZE - 1) / PMM_FRAME_SIZE;
+        uint64_t end_frame   = (saved_regions[r].addr + saved_regions[r].len) / PMM_FRAME_SIZE;
+        if (start_frame < lo) start_frame = lo;
+        if (end_frame > hi) end_frame = hi;
+        if (start_frame >= end_frame) continue;
+        // Walk section by section so ram_frames stays per section
+        while (start_frame < end_frame) {
+            uint64_t sec_end = (start_frame | (PMM_SECTION_FRAMES - 1)) + 1;
+            uint64_t chunk_end = end_frame < sec_end ? end_frame : sec_end;
+            uint64_t usable_start = start_frame < reserved_end_frame ? reserved_end_frame : start_frame;
+            section_of(start_frame)->ram_frames += chunk_end - start_frame;
+            usable_frames += chunk_end - start_frame;
+            if (usable_start < chunk_end) {
+                zones_add_managed(usable_start, chunk_end);
+                frames_free_range(usable_start, chunk_end);
+            }
+            start_frame = chunk_end;
+        }
+    }
+}
 
 static void pmm_build_from_regions(struct avail_region* regions, int region_count) {
     uint64_t max_addr = 0;
     total_memory = 0;
+    saved_region_count = 0;
     for (int i=0;i<region_count;i++) {
+        if (regions[i].len == 0) continue;
         uint64_t end = regions[i].addr + regions[i].len;
+        if (end > PMM_MAX_PHYS) end = PMM_MAX_PHYS; // beyond physmap reach
+        if (regions[i].addr >= end) continue;
         if (end > max_addr) max_addr = end;
-        total_memory += regions[i].len;
-    }
-    // Build bitmap of frames
-    // Limit frames actually identity-mapped early (512MB => 256 * 2MB)
-    uint64_t mapped_limit = 512ULL * 1024 * 1024;
-    total_frames = (max_addr + PMM_FRAME_SIZE - 1) / PMM_FRAME_SIZE; // round up
-    uint64_t mapped_frames_limit = mapped_limit / PMM_FRAME_SIZE;
-    if (total_frames > mapped_frames_limit) total_frames = mapped_frames_limit;
-    max_phys_addr_seen = max_addr;
-    uint64_t bitmap_size = (total_frames + 7) / 8; // bytes rounded up
-    terminal_writestring("[PMM] max_addr="); print_hex(max_addr); terminal_writestring(" total_frames="); {
-        char buf[32]; itoa_dec(total_frames, buf); terminal_writestring(buf); }
-    terminal_writestring(" bitmap_size="); { char buf2[32]; itoa_dec(bitmap_size, buf2); terminal_writestring(buf2); terminal_writestring(" bytes\n"); }
-    frame_bitmap = (uint32_t*)((uint64_t)&_kernel_end);
-    // Zero bitmap
-    uint64_t dwords = (bitmap_size + 3) / 4;
-    for (uint64_t i = 0; i < dwords; i++) {
-        frame_bitmap[i] = 0x00000000;
-    }
-    used_frames = 0;
-
-    // Mark regions as free
-    uint64_t free_frames_before = used_frames; // usato per fallback
-    for (int r=0;r<region_count;r++) {
-        uint64_t start_frame = regions[r].addr / PMM_FRAME_SIZE;
-        uint64_t end_frame   = (regions[r].addr + regions[r].len) / PMM_FRAME_SIZE;
-        if (end_frame > total_frames) end_frame = total_frames; // clamp to discovered limit
-    // Do not free frames beyond current identity mapping limit
-        uint64_t mapped_frames = mapped_limit / PMM_FRAME_SIZE;
-        if (end_frame > mapped_frames) end_frame = mapped_frames;
-        if (regions[r].len == 0) continue;
-    // Compact region log (index and size in MB)
-    terminal_writestring("[PMM] region "); { char b[32]; itoa_dec(r, b); terminal_writestring(b); }
-    terminal_writestring(": sizeMB="); { char b1[32]; itoa_dec(regions[r].len / 1024 / 1024, b1); terminal_writestring(b1);} terminal_writestring("\n");
-        for (uint64_t f=start_frame; f<end_frame; f++) {
-            // Mark free (already zero); ensure we don't double count
-            if (bitmap_test(f)) {
-                bitmap_clear(f);
-                used_frames--;
-            }
+        total_memory += end - regions[i].addr;
+        if (saved_region_count < PMM_MAX_REGIONS) {
+            saved_regions[saved_region_count].addr = regions[i].addr;
+            saved_regions[saved_region_count].len = end - regions[i].addr;
+            saved_region_count++;
         }
     }
-    // Protect kernel+bitmap area (mark as used)
-    uint64_t kernel_end_frame = ((uint64_t)frame_bitmap + bitmap_size) / PMM_FRAME_SIZE + 1;
-    for (uint64_t f=0; f<kernel_end_frame; f++) {
-        if (!bitmap_test(f)) { bitmap_set(f); used_frames++; }
+    max_phys_addr_seen = max_addr;
+    max_pfn = max_addr / PMM_FRAME_SIZE;
+    for (uint64_t i = 0; i < PMM_MAX_SECTIONS; i++) sections[i] = NULL;
+    for (int zi = 0; zi < PMM_ZONE_COUNT; zi++) {
+        pmm_zone_t* z = &zones[zi];
+        for (int o = 0; o <= PMM_MAX_ORDER; o++) { z->free_area[o].head = PMM_PFN_NONE; z->free_area[o].count = 0; }
+        z->hint = z->start_pfn;
+        z->managed_frames = z->free_frames = z->watermark = z->fallback_allocs = 0;
     }
-    // Fallback: if no free frames create synthetic region after kernel within mapped limit
-    if (used_frames == 0 || used_frames == total_frames || pmm_get_free_memory() == 0) {
+    present_sections = 0; meta_bytes = 0; free_frames = 0; usable_frames = 0; physmap_ready = 0;
+    deferred_stats = (pmm_deferred_stats_t){0};
+#if PMM_DEFERRED_INIT
+    for (uint64_t i = 0; i < PMM_MAX_SECTIONS / 64; i++) deferred_map[i] = 0;
+#endif
+
+    // Early phase: only sections below the identity limit get metadata, carved right after
+    // the kernel image. Higher memory is added by pmm_init_highmem() once the physmap exists.
+    uint64_t meta_cursor = ((uint64_t)&_kernel_end + 7) & ~7ULL;
+    for (int r=0;r<saved_region_count;r++) {
+        uint64_t start = saved_regions[r].addr;
+        uint64_t end = saved_regions[r].addr + saved_regions[r].len;
+        if (end > PMM_IDENTITY_LIMIT) end = PMM_IDENTITY_LIMIT;
+        for (uint64_t a = start & ~((1ULL << PMM_SECTION_SHIFT) - 1); a < end; a += (1ULL << PMM_SECTION_SHIFT)) {
+            uint64_t sec = a >> PMM_SECTION_SHIFT;
+            if (sections[sec]) continue;
+            section_setup(sec, (uint8_t*)meta_cursor);
+            meta_cursor = (meta_cursor + PMM_SECTION_META_SIZE + 7) & ~7ULL;
+        }
+        // Compact region log (index and size in MB)
+        terminal_writestring("[PMM] region "); { char b[32]; itoa_dec(r, b); terminal_writestring(b); }
+        terminal_writestring(": sizeMB="); { char b1[32]; itoa_dec(saved_regions[r].len / 1024 / 1024, b1); terminal_writestring(b1);} terminal_writestring("\n");
+    }
+    // Protect low memory + kernel + metadata
+    reserved_end_frame = (meta_cursor + PMM_FRAME_SIZE - 1) / PMM_FRAME_SIZE;
+    terminal_writestring("[PMM] max_addr="); print_hex(max_addr); terminal_writestring(" sections="); {
+        char buf[32]; itoa_dec(present_sections, buf); terminal_writestring(buf); }
+    terminal_writestring(" metadata="); { char buf2[32]; itoa_dec(meta_bytes, buf2); terminal_writestring(buf2); terminal_writestring(" bytes\n"); }
+
+    pmm_add_regions(0, PMM_LOW_PFN_LIMIT);
+    // Fallback: if no free frames create synthetic region after kernel within the first section
+    if (free_frames == 0 && sections[0]) {
         terminal_writestring("[PMM][WARN] Nessun frame libero dalle regioni; applico fallback sintetico\n");
-        uint64_t fallback_start = ((uint64_t)frame_bitmap + bitmap_size + PMM_FRAME_SIZE -1) & ~(PMM_FRAME_SIZE-1);
-        uint64_t fallback_end = mapped_limit;
-        uint64_t start_f = fallback_start / PMM_FRAME_SIZE;
-        uint64_t end_f = fallback_end / PMM_FRAME_SIZE;
-        if (end_f > total_frames) end_f = total_frames;
-        for (uint64_t f = start_f; f < end_f; f++) {
-            if (!bitmap_test(f)) {
-                // leave as free
-            }
+        uint64_t end_f = PMM_SECTION_FRAMES;
+        if (end_f > reserved_end_frame) {
+            usable_frames += end_f - reserved_end_frame;
+            sections[0]->ram_frames += end_f - reserved_end_frame;
+            if (max_pfn < end_f) max_pfn = end_f;
+            zones_add_managed(reserved_end_frame, end_f);
+            frames_free_range(reserved_end_frame, end_f);
         }
-    // Recount used frames (protect kernel) - simple: mark kernel frames, keep rest free
-        used_frames = 0;
-        for (uint64_t f=0; f<kernel_end_frame; f++) { if (!bitmap_test(f)) { bitmap_set(f); used_frames++; } }
     }
+    zones_update_watermarks();
     terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_GREEN, VGA_COLOR_BLACK));
-    terminal_writestring("[OK] PMM initialized\n");
+    terminal_writestring("[OK] PMM initialized (buddy allocator)\n");
     pmm_print_stats();
 }
 
+// Set up one section above the identity limit. Metadata is carved from the section's
+// own RAM (first run large enough), so a section can be brought up even when every
+// managed frame is in use; tiny sections fall back to frames already managed.
+// The rest of its RAM then goes to the free structures of its zone.
+static bool highmem_section_init(uint64_t sec) {
+    uint64_t frames = (PMM_SECTION_META_SIZE + PMM_FRAME_SIZE - 1) / PMM_FRAME_SIZE;
+    uint64_t lo = sec * PMM_SECTION_FRAMES, hi = lo + PMM_SECTION_FRAMES;
+    uint64_t meta = PMM_PFN_NONE;
+    for (int r=0;r<saved_region_count && meta == PMM_PFN_NONE;r++) {
+        uint64_t a = (saved_regions[r].addr + PMM_FRAME_SIZE - 1) / PMM_FRAME_SIZE;
+        uint64_t b = (saved_regions[r].addr + saved_regions[r].len) / PMM_FRAME_SIZE;
+        if (a < lo) a = lo;
+        if (b > hi) b = hi;
+        if (a < b && b - a >= frames) meta = a;
+    }
+    if (meta == PMM_PFN_NONE) {
+        void* p = pmm_alloc_frames(frames, 0);
+        if (!p) { terminal_writestring("[PMM][WARN] highmem: metadata alloc fail\n"); return false; }
+        section_setup(sec, (uint8_t*)phys_to_virt((uint64_t)p));
+        pmm_add_regions(lo, hi);
+    } else {
+        pmm_section_t* s = section_setup(sec, (uint8_t*)phys_to_virt(meta * PMM_FRAME_SIZE));
+        // Metadata frames stay used (reserved descriptors) but count as RAM
+        s->ram_frames += frames;
+        usable_frames += frames;
+        pmm_add_regions(lo, meta);
+        pmm_add_regions(meta + frames, hi);
+    }
+    zones_update_watermarks();
+    return true;
+}
+
+#if PMM_DEFERRED_INIT
+// RAM frames of the saved regions inside section 'sec'
+static uint64_t section_ram_frames(uint64_t sec) {
+    uint64_t lo = sec * PMM_SECTION_FRAMES, hi = lo + PMM_SECTION_FRAMES, n = 0;
+    for (int r=0;r<saved_region_count;r++) {
+        uint64_t a = (saved_regions[r].addr + PMM_FRAME_SIZE - 1) / PMM_FRAME_SIZE;
+        uint64_t b = (saved_regions[r].addr + saved_regions[r].len) / PMM_FRAME_SIZE;
+        if (a < lo) a = lo;
+        if (b > hi) b = hi;
+        if (a < b) n += b - a;
+    }
+    return n;
+}
+
+// First pending section in [lo, hi), PMM_PFN_NONE if none
+static uint64_t deferred_find(uint64_t lo, uint64_t hi) {
+    if (hi > PMM_MAX_SECTIONS) hi = PMM_MAX_SECTIONS;
+    for (uint64_t w = lo / 64; w * 64 < hi; w++) {
+        uint64_t bits = deferred_map[w];
+        if (w == lo / 64) bits &= ~0ULL << (lo % 64);
+        if (!bits) continue;
+        uint64_t sec = w * 64 + (uint64_t)__builtin_ctzll(bits);
+        return sec < hi ? sec : PMM_PFN_NONE;
+    }
+    return PMM_PFN_NONE;
+}
+
+static bool deferred_section_init(uint64_t sec) {
+    uint64_t t0 = timer_rdtsc();
+    deferred_busy = true;
+    bool ok = highmem_section_init(sec);
+    deferred_busy = false;
+    if (!ok) return false; // no frames for the metadata: the section stays pending
+    deferred_map[sec / 64] &= ~(1ULL << (sec % 64));
+    deferred_stats.pending_sections--;
+    deferred_stats.pending_frames -= sections[sec]->ram_frames;
+    uint64_t t1 = timer_rdtsc();
+    deferred_stats.init_cycles += t1 - t0;
+    if (!deferred_stats.pending_sections) deferred_stats.done_tsc = t1;
+    return true;
+}
+
+// Set up the first pending section of zones zone_hi..zone_lo (highest zone first)
+static bool deferred_grow(int zone_hi, int zone_lo) {
+    for (int zi = zone_hi; zi >= zone_lo; zi--) {
+        uint64_t sec = deferred_find(zones[zi].start_pfn / PMM_SECTION_FRAMES,
+                                     (zones[zi].end_pfn + PMM_SECTION_FRAMES - 1) / PMM_SECTION_FRAMES);
+        if (sec == PMM_PFN_NONE) continue;
+        if (!deferred_section_init(sec)) return false;
+        deferred_stats.lazy_inits++;
+        return true;
+    }
+    return false;
+}
+
+// Idle hook: one pending section per wakeup (about 256KB of metadata writes)
+void pmm_deferred_init_idle(void) {
+    if (!deferred_stats.pending_sections) return;
+    uint64_t sec = deferred_find(0, PMM_MAX_SECTIONS);
+    if (sec != PMM_PFN_NONE && deferred_section_init(sec)) deferred_stats.idle_inits++;
+}
+#else
+void pmm_deferred_init_idle(void) { }
+#endif // PMM_DEFERRED_INIT
+
+// Second phase (after vmm_init_physmap): switch frame access to the physmap and add
+// every section above the identity limit, or with PMM_DEFERRED_INIT only record them
+// as pending (set up later by allocations and the idle loop).
+void pmm_init_highmem(void) {
+    physmap_ready = 1;
+    uint64_t added_before = usable_frames;
+    uint64_t t0 = timer_rdtsc();
+    for (int r=0;r<saved_region_count;r++) {
+        uint64_t start = saved_regions[r].addr;
+        uint64_t end = saved_regions[r].addr + saved_regions[r].len;
+        if (end <= PMM_IDENTITY_LIMIT) continue;
+        if (start < PMM_IDENTITY_LIMIT) start = PMM_IDENTITY_LIMIT;
+        for (uint64_t a = start & ~((1ULL << PMM_SECTION_SHIFT) - 1); a < end; a += (1ULL << PMM_SECTION_SHIFT)) {
+            uint64_t sec = a >> PMM_SECTION_SHIFT;
+            if (sections[sec]) continue;
+#if PMM_DEFERRED_INIT
+            if (deferred_map[sec / 64] & (1ULL << (sec % 64))) continue;
+            deferred_map[sec / 64] |= 1ULL << (sec % 64);
+            deferred_stats.pending_sections++;
+            deferred_stats.pending_frames += section_ram_frames(sec);
+#else
+            if (!highmem_section_init(sec)) return;
+#endif
+        }
+    }
+    deferred_stats.init_cycles += timer_rdtsc() - t0;
+    if (usable_frames > added_before) {
+        terminal_writestring("[PMM] highmem added MB=");
+        { char b[32]; itoa_dec((usable_frames - added_before) * PMM_FRAME_SIZE / 1024 / 1024, b); terminal_writestring(b); }
+        terminal_writestring(" sections="); { char b[32]; itoa_dec(present_sections, b); terminal_writestring(b); }
+        terminal_writestring(" metadata="); { char b[32]; itoa_dec(meta_bytes, b); terminal_writestring(b); }
+        terminal_writestring(" bytes\n");
+    }
+    if (deferred_stats.pending_sections) {
+        terminal_writestring("[PMM] deferred MB=");
+        { char b[32]; itoa_dec(deferred_stats.pending_frames * PMM_FRAME_SIZE / 1024 / 1024, b); terminal_writestring(b); }
+        terminal_writestring(" sections="); { char b[32]; itoa_dec(deferred_stats.pending_sections, b); terminal_writestring(b); }
+        terminal_writestring(" (set up on demand / at idle)\n");
+    }
+}
+
+void pmm_get_deferred_stats(pmm_deferred_stats_t* out) {
+    if (out) *out = deferred_stats;
+}
+
 uint64_t pmm_get_max_phys(void) { return max_phys_addr_seen; }
+uint64_t pmm_get_reserved_end(void) { return reserved_end_frame * PMM_FRAME_SIZE; }
 
 // Initialize PMM (Multiboot1)
 void pmm_init(void* mboot_info_ptr) {
@@ -185,15 +736,6 @@ void pmm_init(void* mboot_info_ptr) {
         }
         mmap = (struct multiboot_mmap_entry*)((uint64_t)mmap + mmap->size + sizeof(mmap->size));
     }
-    // Clamp region length to 128MB identity map for early phase
-    uint64_t identity_limit = 128ULL * 1024 * 1024;
-    for (int r=0; r<rc; r++) {
-        uint64_t end = regions[r].addr + regions[r].len;
-        if (end > identity_limit) {
-            if (regions[r].addr >= identity_limit) { regions[r].len = 0; }
-            else regions[r].len = identity_limit - regions[r].addr;
-        }
-    }
     pmm_build_from_regions(regions, rc);
 }
 
@@ -240,45 +782,385 @@ void pmm_init_mb2(void* mb2_info_ptr) {
     pmm_build_from_regions(regions, rc);
 }
 
-// Allocate one physical frame
+static bool pmm_reclaim(void);
+
+// Allocate one physical frame (may lie above the identity map)
 void* pmm_alloc_frame(void) {
-    uint32_t frame = find_free_frame();
+    uint64_t frame = frames_alloc(0, PMM_ZONE_NORMAL);
+    if (frame == PMM_PFN_NONE && pmm_reclaim()) frame = frames_alloc(0, PMM_ZONE_NORMAL);
     
-    if (frame == (uint32_t)-1) {
+    if (frame == PMM_PFN_NONE) {
     return NULL;  // Out of memory
     }
     
-    bitmap_set(frame);
-    used_frames++;
-    
-    return (void*)((uint64_t)frame * PMM_FRAME_SIZE);
+    return (void*)(frame * PMM_FRAME_SIZE);
+}
+
+// Allocate one physical frame below PMM_IDENTITY_LIMIT
+void* pmm_alloc_frame_low(void) {
+    return pmm_alloc_frame_zone(PMM_ZONE_LOW);
 }
 
-// Free a physical frame
+// Allocate one physical frame from 'zone' or a lower zone (above its watermark)
+void* pmm_alloc_frame_zone(int zone) {
+    if (zone < 0 || zone >= PMM_ZONE_COUNT) return NULL;
+    uint64_t frame = frames_alloc(0, zone);
+    if (frame == PMM_PFN_NONE && pmm_reclaim()) frame = frames_alloc(0, zone);
+    if (frame == PMM_PFN_NONE) return NULL;
+    return (void*)(frame * PMM_FRAME_SIZE);
+}
+
+// Free a physical frame: drops one reference, the frame goes back to the allocator
+// when the last one is gone (same as pmm_page_put)
 void pmm_free_frame(void* addr) {
-    uint32_t frame = (uint64_t)addr / PMM_FRAME_SIZE;
-    
-    if (!bitmap_test(frame)) {
-    return;  // Already free
+    pmm_page_put((uint64_t)addr);
+}
+
+// ---- Frame descriptors (struct page) ----
+pmm_page_t* pmm_page(uint64_t phys) {
+    uint64_t frame = phys / PMM_FRAME_SIZE;
+    if (frame >= max_pfn) return NULL;
+    pmm_section_t* s = section_of(frame);
+    return s ? &s->pages[section_offset(frame)] : NULL;
+}
+
+// Take an extra reference on an allocated frame (sharing between address spaces).
+// Saturation is sticky: once the count reaches PMM_PAGE_REF_MAX, gets and puts no longer
+// change it and the frame is never freed (leaked, but never released while still mapped).
+void pmm_page_get(uint64_t phys) {
+    uint64_t frame = phys / PMM_FRAME_SIZE;
+    if (!pfn_managed(frame) || !bitmap_test(frame)) return;
+    pmm_page_t* pg = pmm_page(phys);
+    if (pg->refcount == PMM_PAGE_REF_MAX) return;
+    if (++pg->refcount == PMM_PAGE_REF_MAX) {
+        terminal_writestring("[PMM] refcount saturated, frame pinned for good: ");
+        print_hex(phys & ~(uint64_t)(PMM_FRAME_SIZE - 1));
+        terminal_writestring("\n");
     }
-    
-    bitmap_clear(frame);
-    used_frames--;
 }
 
+// Drop a reference; returns true when the frame was released to the allocator.
+// Pinned frames keep their last reference until unpinned.
+bool pmm_page_put(uint64_t phys) {
+    uint64_t frame = phys / PMM_FRAME_SIZE;
+    if (!pfn_managed(frame)) return false;   // Not managed by the PMM
+    if (!bitmap_test(frame)) return false;   // Already free
+    pmm_page_t* pg = pmm_page(phys);
+    if (pg->refcount == PMM_PAGE_REF_MAX) return false; // saturated: count no longer exact
+    if (pg->refcount > 1) { pg->refcount--; return false; }
+    if (pg->flags & PMM_PAGE_PINNED) return false;
+    frames_free(frame, 0);
+    return true;
+}
+
+uint16_t pmm_page_refcount(uint64_t phys) {
+    pmm_page_t* pg = pmm_page(phys);
+    return pg ? pg->refcount : 0;
+}
+
+void pmm_page_set_flags(uint64_t phys, uint8_t flags) {
+    pmm_page_t* pg = pmm_page(phys);
+    if (pg && bitmap_test(phys / PMM_FRAME_SIZE)) pg->flags |= flags;
+}
+
+void pmm_page_clear_flags(uint64_t phys, uint8_t flags) {
+    pmm_page_t* pg = pmm_page(phys);
+    if (pg && bitmap_test(phys / PMM_FRAME_SIZE)) pg->flags &= (uint8_t)~flags;
+}
+
+void pmm_page_set_owner(uint64_t phys, uint32_t owner) {
+    pmm_page_t* pg = pmm_page(phys);
+    if (pg && bitmap_test(phys / PMM_FRAME_SIZE)) pg->owner = owner;
+}
+
+// Smallest order whose block covers 'count' frames
+static unsigned order_for_count(uint64_t count) {
+    unsigned order = 0;
+    while (order <= PMM_MAX_ORDER && (1ULL << order) < count) order++;
+    return order;
+}
+
+// Allocate 'count' physically contiguous frames. The start is aligned to 'align' bytes
+// (rounded up to a power-of-two number of frames): buddy blocks are naturally aligned,
+// so alignment only raises the order. The smallest fitting block is split (best fit) and
+// the unused tail beyond 'count' goes straight back to the free lists.
+void* pmm_alloc_frames(uint64_t count, uint64_t align) {
+    return pmm_alloc_frames_zone(count, align, PMM_ZONE_NORMAL);
+}
+
+// Contiguous allocation limited to 'zone' and lower zones (e.g. DMA buffers)
+void* pmm_alloc_frames_zone(uint64_t count, uint64_t align, int zone) {
+    if (count == 0 || zone < 0 || zone >= PMM_ZONE_COUNT) return NULL;
+    unsigned order = order_for_count(count);
+    uint64_t align_frames = (align + PMM_FRAME_SIZE - 1) / PMM_FRAME_SIZE;
+    unsigned align_order = order_for_count(align_frames);
+    if (align_order > order) order = align_order;
+    if (order > PMM_MAX_ORDER) return NULL;
+    uint64_t frame = frames_alloc(order, zone);
+    if (frame == PMM_PFN_NONE && pmm_reclaim()) frame = frames_alloc(order, zone);
+    if (frame == PMM_PFN_NONE) return NULL;
+    uint64_t block = 1ULL << order;
+    if (count < block) frames_free_range(frame + count, frame + block);
+    return (void*)(frame * PMM_FRAME_SIZE);
+}
+
+// Free 'count' contiguous frames starting at addr (any range previously returned by
+// pmm_alloc_frames, or a sub-range of it). Already free frames are skipped.
+void pmm_free_frames(void* addr, uint64_t count) {
+    uint64_t start = (uint64_t)addr / PMM_FRAME_SIZE;
+    uint64_t end = start + count;
+    if (start < reserved_end_frame) start = reserved_end_frame;
+    if (end > max_pfn) end = max_pfn;
+    if (start >= end || !section_of(start) || !section_of(end - 1)) return;
+    frames_free_range(start, end);
+}
+
+// Longest run of free frames (scans the section bitmaps, report use only)
+uint64_t pmm_get_largest_free_run(void) {
+    uint64_t best = 0, run = 0;
+    for (uint64_t sec = 0; sec < PMM_MAX_SECTIONS; sec++) {
+        pmm_section_t* s = sections[sec];
+        if (!s) { if (run > best) best = run; run = 0; continue; }
+        for (uint64_t w = 0; w < PMM_SECTION_FRAMES / 64; w++) {
+            uint64_t word = s->bitmap[w];
+            if (word == ~0ULL) { if (run > best) best = run; run = 0; continue; }
+            if (word == 0) { run += 64; continue; }
+            for (int bit = 0; bit < 64; bit++) {
+                if (word & (1ULL << bit)) { if (run > best) best = run; run = 0; }
+                else run++;
+            }
+        }
+    }
+    if (run > best) best = run;
+    return best;
+}
+
+// Per-zone counters (frames); returns -1 for an invalid zone
+int pmm_get_zone_info(int zone, pmm_zone_info_t* out) {
+    if (zone < 0 || zone >= PMM_ZONE_COUNT || !out) return -1;
+    const pmm_zone_t* z = &zones[zone];
+    out->name = z->name;
+    out->start = z->start_pfn * PMM_FRAME_SIZE;
+    out->end = z->end_pfn * PMM_FRAME_SIZE;
+    out->managed_frames = z->managed_frames;
+    out->free_frames = z->free_frames;
+    out->watermark = z->watermark;
+    out->fallback_allocs = z->fallback_allocs;
+    return 0;
+}
+
+// Number of free blocks of a given order
+uint64_t pmm_get_free_blocks(unsigned order) {
+    if (order > PMM_MAX_ORDER) return 0;
+    uint64_t n = 0;
+    for (int zi = 0; zi < PMM_ZONE_COUNT; zi++) n += zones[zi].free_area[order].count;
+    return n;
+}
+
+// ---- Pre-zeroed frame pool ----
+// Frames are cleared while the CPU is idle so that page-table and user-page allocations
+// do not pay for a 4KB memset on their critical path. Two pools: low frames (identity
+// accessible, for page tables created before the physmap) and any frames (page tables
+// and user pages afterwards, accessed via the physmap).
+// Pooled frames are allocated from the buddy lists and count as used memory.
+typedef struct pmm_zero_pool {
+    uint64_t frames[PMM_ZERO_POOL_SIZE];
+    unsigned count;
+} pmm_zero_pool_t;
+
+static pmm_zero_pool_t zero_pool[2];   // [0] = any, [1] = low
+static pmm_zero_pool_stats_t zero_stats;
+
+// Clear one frame with rep stosq (512 qwords)
+static void pmm_clear_frame(uint64_t frame) {
+    void* p = pmm_phys_ptr(frame * PMM_FRAME_SIZE);
+    uint64_t cnt = PMM_FRAME_SIZE / 8;
+    __asm__ volatile ("rep stosq" : "+D"(p), "+c"(cnt) : "a"(0ULL) : "memory");
+}
+
+static void* zero_pool_take(bool low) {
+    pmm_zero_pool_t* zp = &zero_pool[low ? 1 : 0];
+    if (zp->count) {
+        zero_stats.hits++;
+        return (void*)(zp->frames[--zp->count] * PMM_FRAME_SIZE);
+    }
+    zero_stats.misses++;
+    uint64_t frame = frames_alloc(0, low ? PMM_ZONE_LOW : PMM_ZONE_NORMAL);
+    if (frame == PMM_PFN_NONE) return NULL;
+    pmm_clear_frame(frame);
+    pmm_page(frame * PMM_FRAME_SIZE)->flags |= PMM_PAGE_ZEROED;
+    return (void*)(frame * PMM_FRAME_SIZE);
+}
+
+// Allocate a zero-filled frame (any address), from the pool when possible
+void* pmm_alloc_zeroed_frame(void) { return zero_pool_take(false); }
+
+// Allocate a zero-filled frame below PMM_IDENTITY_LIMIT
+void* pmm_alloc_zeroed_frame_low(void) { return zero_pool_take(true); }
+
+// Zero up to 'budget' frames into the pools. The low pool only matters before the physmap
+// exists (identity-reached page tables) and is not refilled afterwards.
+// Stops early when free memory runs short so the pools never starve real allocations.
+unsigned pmm_zero_pool_refill(unsigned budget) {
+    unsigned done = 0;
+    for (int i = physmap_ready ? 0 : 1; i >= 0 && done < budget; i--) {
+        pmm_zero_pool_t* zp = &zero_pool[i];
+        while (zp->count < PMM_ZERO_POOL_SIZE && done < budget) {
+            if (free_frames < PMM_ZERO_POOL_RESERVE) return done;
+            uint64_t frame = frames_alloc(0, i == 1 ? PMM_ZONE_LOW : PMM_ZONE_NORMAL);
+            if (frame == PMM_PFN_NONE) break;
+            pmm_clear_frame(frame);
+            pmm_page(frame * PMM_FRAME_SIZE)->flags |= PMM_PAGE_ZEROED;
+            zp->frames[zp->count++] = frame;
+            zero_stats.refilled++;
+            done++;
+        }
+    }
+    return done;
+}
+
+// Idle hook: small batches keep keyboard/timer wakeup latency low
+void pmm_zero_pool_idle(void) {
+    pmm_zero_pool_refill(PMM_ZERO_POOL_IDLE_BATCH);
+}
+
+// Return every pooled frame to the buddy lists (low memory pressure)
+void pmm_zero_pool_drain(void) {
+    for (int i = 0; i < 2; i++) {
+        while (zero_pool[i].count) frames_free(zero_pool[i].frames[--zero_pool[i].count], 0);
+    }
+}
+
+static uint64_t colour_bins_drain(void);
+
+// Allocation failed: give pooled and binned frames back so the caller can retry
+static bool pmm_reclaim(void) {
+    bool pooled = zero_pool[0].count || zero_pool[1].count;
+    if (pooled) pmm_zero_pool_drain();
+    return colour_bins_drain() > 0 || pooled;
+}
+
+void pmm_get_zero_pool_stats(pmm_zero_pool_stats_t* out) {
+    if (!out) return;
+    *out = zero_stats;
+    out->pooled_any = zero_pool[0].count;
+    out->pooled_low = zero_pool[1].count;
+}
+
+// ---- Page colouring ----
+// Frames map to LLC sets by pfn % PMM_COLOURS. A coloured request takes a frame from the
+// per-colour bins if one of its colours is available; otherwise it splits an aligned block
+// of PMM_COLOURS frames (one frame of every colour), keeps a matching frame and bins the
+// rest for later requests. Binned frames are allocated from the zones and count as used;
+// bins are capped and drained back when an allocation would otherwise fail.
+#if PMM_COLOURS
+#define PMM_COLOUR_ORDER   ((unsigned)__builtin_ctz(PMM_COLOURS))
+#define PMM_COLOUR_BIN_MAX 64   // frames kept per colour
+
+typedef struct pmm_colour_bin {
+    uint64_t head;   // pfn list linked through the frames (pmm_free_block_t.next)
+    uint64_t count;
+} pmm_colour_bin_t;
+
+static pmm_colour_bin_t colour_bins[PMM_COLOURS];
+static unsigned colour_cursor = 0;  // rotates the starting colour so masks spread evenly
+static pmm_colour_stats_t colour_stats;
+
+static void colour_bin_push(uint64_t frame) {
+    pmm_colour_bin_t* b = &colour_bins[frame % PMM_COLOURS];
+    if (b->count >= PMM_COLOUR_BIN_MAX) { frames_free(frame, 0); return; }
+    block_at(frame)->next = b->count ? b->head : PMM_PFN_NONE;
+    b->head = frame;
+    b->count++;
+}
+
+static uint64_t colour_bin_pop(unsigned c) {
+    pmm_colour_bin_t* b = &colour_bins[c];
+    if (!b->count) return PMM_PFN_NONE;
+    uint64_t frame = b->head;
+    b->head = block_at(frame)->next;
+    b->count--;
+    return frame;
+}
+
+static uint64_t colour_bins_drain(void) {
+    uint64_t n = 0;
+    for (unsigned c = 0; c < PMM_COLOURS; c++) {
+        uint64_t f;
+        while ((f = colour_bin_pop(c)) != PMM_PFN_NONE) { frames_free(f, 0); n++; }
+    }
+    return n;
+}
+
+// First colour set in mask, starting from the rotating cursor
+static int colour_pick(uint64_t mask, bool need_binned) {
+    for (unsigned i = 0; i < PMM_COLOURS; i++) {
+        unsigned c = (colour_cursor + i) % PMM_COLOURS;
+        if (!(mask & (1ULL << c))) continue;
+        if (need_binned && !colour_bins[c].count) continue;
+        colour_cursor = c + 1;
+        return (int)c;
+    }
+    return -1;
+}
+
+// Allocate a zero-filled frame whose colour is in 'mask' (bit c = colour c).
+// mask 0 or covering every colour behaves like pmm_alloc_zeroed_frame().
+void* pmm_alloc_coloured_frame(uint64_t mask) {
+    uint64_t all = (PMM_COLOURS == 64) ? ~0ULL : ((1ULL << PMM_COLOURS) - 1);
+    mask &= all;
+    if (mask == 0 || mask == all) return pmm_alloc_zeroed_frame();
+    uint64_t frame = PMM_PFN_NONE;
+    int c = colour_pick(mask, true);
+    if (c >= 0) {
+        frame = colour_bin_pop((unsigned)c);
+        colour_stats.bin_hits++;
+    } else {
+        // Miss: reclaim and retry like pmm_alloc_frame. Draining the other colours' bins
+        // gives the buddy allocator whole aligned blocks to split again.
+        uint64_t block = frames_alloc(PMM_COLOUR_ORDER, PMM_ZONE_NORMAL);
+        if (block == PMM_PFN_NONE && pmm_reclaim()) block = frames_alloc(PMM_COLOUR_ORDER, PMM_ZONE_NORMAL);
+        if (block == PMM_PFN_NONE) return NULL;
+        colour_stats.block_splits++;
+        c = colour_pick(mask, false);
+        for (uint64_t f = block; f < block + PMM_COLOURS; f++) {
+            if (f % PMM_COLOURS == (uint64_t)c) frame = f;
+            else colour_bin_push(f);
+        }
+    }
+    pmm_clear_frame(frame);
+    pmm_page(frame * PMM_FRAME_SIZE)->flags |= PMM_PAGE_ZEROED;
+    return (void*)(frame * PMM_FRAME_SIZE);
+}
+
+void pmm_get_colour_stats(pmm_colour_stats_t* out) {
+    if (!out) return;
+    *out = colour_stats;
+    out->binned = 0;
+    for (unsigned c = 0; c < PMM_COLOURS; c++) out->binned += colour_bins[c].count;
+}
+#else
+static uint64_t colour_bins_drain(void) { return 0; }
+void* pmm_alloc_coloured_frame(uint64_t mask) { (void)mask; return pmm_alloc_zeroed_frame(); }
+void pmm_get_colour_stats(pmm_colour_stats_t* out) {
+    if (!out) return;
+    out->bin_hits = out->block_splits = out->binned = 0;
+}
+#endif // PMM_COLOURS
+
 // Get total memory (sum of regions)
 uint64_t pmm_get_total_memory(void) {
     return total_memory;
 }
 
-// Get used memory in bytes
+// Get used memory in bytes (usable RAM not sitting in the free lists)
 uint64_t pmm_get_used_memory(void) {
-    return used_frames * PMM_FRAME_SIZE;
+    return (usable_frames - free_frames) * PMM_FRAME_SIZE;
 }
 
 // Get free memory in bytes
 uint64_t pmm_get_free_memory(void) {
-    return (total_frames - used_frames) * PMM_FRAME_SIZE;
+    return free_frames * PMM_FRAME_SIZE;
 }
 
 // Print PMM statistics
@@ -300,6 +1182,74 @@ void pmm_print_stats(void) {
     itoa_dec(pmm_get_free_memory() / 1024 / 1024, buffer);
     terminal_writestring(buffer);
     terminal_writestring(" MB\n");
+
+    if (deferred_stats.pending_sections) {
+        terminal_writestring("     Deferred:       ");
+        itoa_dec(deferred_stats.pending_frames * PMM_FRAME_SIZE / 1024 / 1024, buffer);
+        terminal_writestring(buffer);
+        terminal_writestring(" MB not yet initialised\n");
+    }
     
     terminal_setcolor(vga_entry_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK));
-}
\ No newline at end of file
+}
+
+// Print buddy free lists and largest contiguous free run
+void pmm_print_buddy_info(void) {
+    char buffer[32];
+    terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_CYAN, VGA_COLOR_BLACK));
+#if PMM_USE_BUDDY
+    terminal_writestring("\n=== PMM Buddy Free Lists ===\n");
+#else
+    terminal_writestring("\n=== PMM Summary Bitmap (no free lists) ===\n");
+#endif
+    terminal_setcolor(vga_entry_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK));
+    for (unsigned o = 0; o <= PMM_MAX_ORDER; o++) {
+        terminal_writestring("  order ");
+        itoa_dec(o, buffer); terminal_writestring(buffer);
+        terminal_writestring(o < 10 ? "  (" : " (");
+        itoa_dec((PMM_FRAME_SIZE << o) / 1024, buffer); terminal_writestring(buffer);
+        terminal_writestring(" KB): ");
+        itoa_dec(pmm_get_free_blocks(o), buffer); terminal_writestring(buffer);
+        terminal_writestring(" blocks\n");
+    }
+    uint64_t run = pmm_get_largest_free_run();
+    terminal_writestring("  Largest free run: ");
+    itoa_dec(run, buffer); terminal_writestring(buffer);
+    terminal_writestring(" frames (");
+    itoa_dec(run * PMM_FRAME_SIZE / 1024, buffer); terminal_writestring(buffer);
+    terminal_writestring(" KB)\n");
+    for (int zi = 0; zi < PMM_ZONE_COUNT; zi++) {
+        const pmm_zone_t* z = &zones[zi];
+        if (!z->managed_frames) continue;
+        terminal_writestring("  Zone ");
+        terminal_writestring(z->name);
+        terminal_writestring(": free=");
+        itoa_dec(z->free_frames, buffer); terminal_writestring(buffer);
+        terminal_writestring("/"); itoa_dec(z->managed_frames, buffer); terminal_writestring(buffer);
+        terminal_writestring(" wmark="); itoa_dec(z->watermark, buffer); terminal_writestring(buffer);
+        terminal_writestring(" fallback="); itoa_dec(z->fallback_allocs, buffer); terminal_writestring(buffer);
+        terminal_writestring("\n");
+    }
+    terminal_writestring("  Zero pool: low=");
+    itoa_dec(zero_pool[1].count, buffer); terminal_writestring(buffer);
+    terminal_writestring(" any="); itoa_dec(zero_pool[0].count, buffer); terminal_writestring(buffer);
+    terminal_writestring(" hits="); itoa_dec(zero_stats.hits, buffer); terminal_writestring(buffer);
+    terminal_writestring(" misses="); itoa_dec(zero_stats.misses, buffer); terminal_writestring(buffer);
+    terminal_writestring(" refilled="); itoa_dec(zero_stats.refilled, buffer); terminal_writestring(buffer);
+    if (deferred_stats.lazy_inits || deferred_stats.idle_inits || deferred_stats.pending_sections) {
+        terminal_writestring("\n  Deferred init: pending="); itoa_dec(deferred_stats.pending_sections, buffer); terminal_writestring(buffer);
+        terminal_writestring(" lazy="); itoa_dec(deferred_stats.lazy_inits, buffer); terminal_writestring(buffer);
+        terminal_writestring(" idle="); itoa_dec(deferred_stats.idle_inits, buffer); terminal_writestring(buffer);
+        terminal_writestring(" cycles="); itoa_dec(deferred_stats.init_cycles, buffer); terminal_writestring(buffer);
+    }
+#if PMM_COLOURS
+    {
+        pmm_colour_stats_t cs; pmm_get_colour_stats(&cs);
+        terminal_writestring("\n  Colours: "); itoa_dec(PMM_COLOURS, buffer); terminal_writestring(buffer);
+        terminal_writestring(" binned="); itoa_dec(cs.binned, buffer); terminal_writestring(buffer);
+        terminal_writestring(" bin_hits="); itoa_dec(cs.bin_hits, buffer); terminal_writestring(buffer);
+        terminal_writestring(" splits="); itoa_dec(cs.block_splits, buffer); terminal_writestring(buffer);
+    }
+#endif
+    terminal_writestring("\n\n");
+}
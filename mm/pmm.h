@@ -9,29 +9,147 @@
 #include <stdint.h>
 #include <stddef.h>
 #include <stdbool.h>
+#include "config.h" // PMM_COLOURS, PMM_DEFERRED_INIT
 
 // Frame size (4KB)
 #define PMM_FRAME_SIZE 4096
+// Largest buddy block order (2^10 frames = 4MB contiguous)
+#define PMM_MAX_ORDER  10
+// Physical memory covered by the boot identity map (2MB pages set up in boot.asm).
+// Frames below this limit can be dereferenced directly by early code.
+#define PMM_IDENTITY_LIMIT (512ULL * 1024 * 1024)
+// Zones: a request names the highest zone it accepts; lower zones are used as fallback
+// only while they stay above their watermark
+#define PMM_ZONE_DMA       0   // < 16MB (ISA DMA)
+#define PMM_ZONE_LOW       1   // 16MB .. PMM_IDENTITY_LIMIT (identity mapped)
+#define PMM_ZONE_DMA32     2   // .. 4GB (32-bit DMA)
+#define PMM_ZONE_NORMAL    3   // everything above
+#define PMM_ZONE_COUNT     4
+#define PMM_ZONE_DMA_LIMIT   (16ULL * 1024 * 1024)
+#define PMM_ZONE_DMA32_LIMIT (4ULL * 1024 * 1024 * 1024)
+// Highest physical address tracked (physmap reach: one PDPT of 1GB entries = 512GB)
+#define PMM_MAX_PHYS       (512ULL * 1024 * 1024 * 1024)
 
 // Initialize PMM using Multiboot1 memory map
 void pmm_init(void* mboot_info);
 // Initialize PMM using Multiboot2 structure (info pointer)
 void pmm_init_mb2(void* mb2_info);
+// Second phase, after vmm_init_physmap(): add memory above PMM_IDENTITY_LIMIT
+// (with PMM_DEFERRED_INIT only recorded, set up on first use or at idle)
+void pmm_init_highmem(void);
 
-// Allocate a physical frame
+// Deferred section init counters (PMM_DEFERRED_INIT in config.h)
+typedef struct pmm_deferred_stats {
+    uint64_t pending_sections;  // sections with RAM not set up yet
+    uint64_t pending_frames;    // RAM frames in those sections
+    uint64_t lazy_inits;        // sections set up by an allocation
+    uint64_t idle_inits;        // sections set up from the idle loop
+    uint64_t init_cycles;       // TSC cycles spent on memory above the identity limit
+    uint64_t done_tsc;          // TSC when the last pending section was set up (0 = not yet)
+} pmm_deferred_stats_t;
+void pmm_deferred_init_idle(void);  // idle callback: set up one pending section
+void pmm_get_deferred_stats(pmm_deferred_stats_t* out);
+
+// Allocate a physical frame (any address: access it through phys_to_virt)
 void* pmm_alloc_frame(void);
+// Allocate a physical frame below PMM_IDENTITY_LIMIT (identity-accessible)
+void* pmm_alloc_frame_low(void);
+// Allocate a physical frame from 'zone' (PMM_ZONE_*) or lower zones
+void* pmm_alloc_frame_zone(int zone);
 
-// Free a physical frame
+// Free a physical frame (drops one reference, see pmm_page_put)
 void pmm_free_frame(void* addr);
 
+// Per-frame descriptor (struct page), 8 bytes per frame of every populated section
+#define PMM_PAGE_PINNED    0x01  // never released by pmm_page_put (DMA, kernel stacks)
+#define PMM_PAGE_TABLE     0x02  // backs a paging structure
+#define PMM_PAGE_ZEROED    0x04  // cleared by the zero pool before hand-out
+#define PMM_PAGE_KERNEL    0x08  // kernel-owned (heap, IST stacks)
+#define PMM_PAGE_SLAB      0x10  // kmalloc slab (header at the start of the frame)
+#define PMM_PAGE_RESERVED  0x80  // not RAM / kernel image / PMM metadata
+typedef struct pmm_page {
+    uint16_t refcount;   // 0 = free, 1 = single owner, >1 = shared
+    uint8_t  flags;      // PMM_PAGE_*
+    uint8_t  order;      // buddy order if head of a free block (allocator private)
+    uint32_t owner;      // owner tag (e.g. pid), 0 = none
+} pmm_page_t;
+#define PMM_PAGE_REF_MAX   0xFFFF // saturated refcount: sticky, the frame is never freed
+// Descriptor of the frame containing phys (NULL if not tracked)
+pmm_page_t* pmm_page(uint64_t phys);
+void pmm_page_get(uint64_t phys);          // +1 reference
+bool pmm_page_put(uint64_t phys);          // -1 reference, true if the frame was freed
+uint16_t pmm_page_refcount(uint64_t phys);
+void pmm_page_set_flags(uint64_t phys, uint8_t flags);
+void pmm_page_clear_flags(uint64_t phys, uint8_t flags);
+void pmm_page_set_owner(uint64_t phys, uint32_t owner);
+
+// Allocate 'count' physically contiguous frames aligned to 'align' bytes (0 = frame aligned).
+// count and alignment are limited to 2^PMM_MAX_ORDER frames. Returns NULL on failure.
+void* pmm_alloc_frames(uint64_t count, uint64_t align);
+void* pmm_alloc_frames_zone(uint64_t count, uint64_t align, int zone);
+// Free 'count' contiguous frames starting at addr
+void pmm_free_frames(void* addr, uint64_t count);
+
+// Pre-zeroed frame pool, refilled from the idle loop (sched_idle)
+#define PMM_ZERO_POOL_SIZE        64   // frames per pool (low / any)
+#define PMM_ZERO_POOL_IDLE_BATCH  8    // frames zeroed per idle wakeup
+#define PMM_ZERO_POOL_RESERVE     256  // stop refilling below this many free frames
+typedef struct pmm_zero_pool_stats {
+    uint64_t hits;        // allocations served from the pool
+    uint64_t misses;      // pool empty: frame cleared inline
+    uint64_t refilled;    // frames zeroed in the background
+    uint64_t pooled_low;  // frames currently pooled
+    uint64_t pooled_any;
+} pmm_zero_pool_stats_t;
+// Allocate a zero-filled frame (any address / below PMM_IDENTITY_LIMIT)
+void* pmm_alloc_zeroed_frame(void);
+void* pmm_alloc_zeroed_frame_low(void);
+unsigned pmm_zero_pool_refill(unsigned budget); // returns frames zeroed
+void pmm_zero_pool_idle(void);                  // idle callback
+void pmm_zero_pool_drain(void);
+void pmm_get_zero_pool_stats(pmm_zero_pool_stats_t* out);
+
+// Page colouring (PMM_COLOURS in config.h): colour of a frame = pfn % PMM_COLOURS
+#if PMM_COLOURS
+static inline unsigned pmm_frame_colour(uint64_t phys) { return (unsigned)((phys / PMM_FRAME_SIZE) % PMM_COLOURS); }
+#else
+static inline unsigned pmm_frame_colour(uint64_t phys) { (void)phys; return 0; }
+#endif
+typedef struct pmm_colour_stats {
+    uint64_t bin_hits;      // coloured requests served from the bins
+    uint64_t block_splits;  // colour blocks split into the bins
+    uint64_t binned;        // frames currently binned
+} pmm_colour_stats_t;
+// Zero-filled frame with colour in 'mask' (bit c = colour c, 0 = any colour)
+void* pmm_alloc_coloured_frame(uint64_t mask);
+void pmm_get_colour_stats(pmm_colour_stats_t* out);
+
 // Memory info accessors
 uint64_t pmm_get_total_memory(void);
 uint64_t pmm_get_used_memory(void);
 uint64_t pmm_get_free_memory(void);
 // Maximum physical address seen (end address, not size)
 uint64_t pmm_get_max_phys(void);
+// End of the boot-reserved area (low memory, kernel image, early section metadata)
+uint64_t pmm_get_reserved_end(void);
+
+// Zone counters
+typedef struct pmm_zone_info {
+    const char* name;
+    uint64_t start, end;        // physical range [start, end)
+    uint64_t managed_frames;
+    uint64_t free_frames;
+    uint64_t watermark;         // frames kept from fallback requests
+    uint64_t fallback_allocs;   // blocks served for a higher zone
+} pmm_zone_info_t;
+int pmm_get_zone_info(int zone, pmm_zone_info_t* out);
+
+// Fragmentation info
+uint64_t pmm_get_largest_free_run(void);   // in frames
+uint64_t pmm_get_free_blocks(unsigned order);
 
 // Debug
 void pmm_print_stats(void);
+void pmm_print_buddy_info(void);
 
 #endif
\ No newline at end of file
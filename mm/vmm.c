@@ -12,6 +12,8 @@
 
 // Basic page table constants
 #define PAGE_SIZE 4096ULL
+#define HUGE_PAGE_SIZE (2ULL * 1024 * 1024)
+#define HUGE_PAGE_FRAMES 512
 #define PT_ENTRIES 512
 
 // Address mask constant
@@ -20,9 +22,31 @@
 static vmm_space_t kernel_space;
 static int physmap_initialized = 0;
 static uint64_t physmap_limit = 0; // physical memory currently covered by physmap
+static kmem_cache_t* space_cache = NULL; // user address space descriptors
+static kmem_cache_t* vma_cache = NULL;   // vmm_vma_t nodes
+static vmm_space_t* current_space = &kernel_space; // last space loaded by vmm_switch_space
 
-// Forward declaration
-static void zero_frame(uint64_t phys);
+// Kernel pointer to a paging structure: through the boot identity map only until
+// vmm_init_physmap() has run, through the physmap afterwards (any frame in RAM).
+static inline uint64_t* table_ptr(uint64_t phys) {
+    phys &= ADDRESS_MASK;
+    return physmap_initialized ? (uint64_t*)phys_to_virt(phys) : (uint64_t*)phys;
+}
+
+// Table frames released by space teardown: already zeroed and flagged PMM_PAGE_TABLE, so
+// the next vmm_space_create_user() / page walk reuses them without touching the PMM.
+#define TABLE_POOL_MAX 64
+static uint64_t table_pool[TABLE_POOL_MAX];
+static uint32_t table_pool_count = 0;
+
+// Zeroed frame for a new paging structure. Before the physmap exists the table must
+// be identity-reachable (LOW zone); afterwards any zone will do.
+static void* alloc_table_frame(void) {
+    if (physmap_initialized && table_pool_count) return (void*)table_pool[--table_pool_count];
+    void* frame = physmap_initialized ? pmm_alloc_zeroed_frame() : pmm_alloc_zeroed_frame_low();
+    if (frame) pmm_page_set_flags((uint64_t)frame, PMM_PAGE_TABLE);
+    return frame;
+}
 
 // Extend physmap (already initialized) to cover at least phys_end.
 // Uses 2MB huge pages like vmm_init_physmap.
@@ -32,29 +56,28 @@ void vmm_extend_physmap(uint64_t phys_end) {
     uint64_t target = (phys_end + HUGE_SIZE - 1) & ~(HUGE_SIZE - 1);
     if (target <= physmap_limit) return;
 
-    uint64_t pml4_phys = kernel_space.pml4_phys & ADDRESS_MASK;
-    uint64_t* pml4 = (uint64_t*)pml4_phys;
+    uint64_t* pml4 = table_ptr(kernel_space.pml4_phys);
     int pml4_i = (VMM_PHYSMAP_BASE >> 39) & 0x1FF;
     int pdpt_i_start = (VMM_PHYSMAP_BASE >> 30) & 0x1FF;
     if (!(pml4[pml4_i] & VMM_FLAG_PRESENT)) { terminal_writestring("[ERR] extend physmap: PDPT missing\n"); return; }
-    uint64_t* pdpt = (uint64_t*)(pml4[pml4_i] & ADDRESS_MASK);
+    uint64_t* pdpt = table_ptr(pml4[pml4_i]);
     uint64_t phys_cursor = physmap_limit;
     while (phys_cursor < target) {
         int pdpt_i = pdpt_i_start + ((phys_cursor >> 30) & 0x1FF);
     if (pdpt_i >= 512) { terminal_writestring("[WARN] extend physmap: exceeded PDPT range\n"); break; }
-        uint64_t* pdt = (uint64_t*)(pdpt[pdpt_i] & ADDRESS_MASK);
+        uint64_t* pdt = table_ptr(pdpt[pdpt_i]);
         if (!(pdpt[pdpt_i] & VMM_FLAG_PRESENT)) {
-            void* frame = pmm_alloc_frame(); if (!frame) { terminal_writestring("[ERR] extend physmap: PDT alloc fail\n"); break; }
-            zero_frame((uint64_t)frame);
+            // Any RAM frame: the physmap built at boot already covers all of RAM
+            void* frame = alloc_table_frame(); if (!frame) { terminal_writestring("[ERR] extend physmap: PDT alloc fail\n"); break; }
             pdpt[pdpt_i] = ((uint64_t)frame & ADDRESS_MASK) | VMM_FLAG_PRESENT | VMM_FLAG_RW;
-            pdt = (uint64_t*)(((uint64_t)frame) & ADDRESS_MASK);
+            pdt = table_ptr((uint64_t)frame);
         }
         for (int pdt_i=0; pdt_i<512 && phys_cursor < target; pdt_i++) {
             uint64_t virt = VMM_PHYSMAP_BASE + phys_cursor;
             int virt_pdt_i = (virt >> 21) & 0x1FF;
             if (virt_pdt_i != pdt_i) continue;
             if (!(pdt[pdt_i] & VMM_FLAG_PRESENT)) {
-                pdt[pdt_i] = (phys_cursor & ADDRESS_MASK) | VMM_FLAG_PRESENT | VMM_FLAG_RW | VMM_FLAG_PS | VMM_FLAG_NOEXEC;
+                pdt[pdt_i] = (phys_cursor & ADDRESS_MASK) | VMM_FLAG_PRESENT | VMM_FLAG_RW | VMM_FLAG_PS | VMM_FLAG_NOEXEC | VMM_FLAG_GLOBAL;
             }
             phys_cursor += HUGE_SIZE;
         }
@@ -65,62 +88,269 @@ void vmm_extend_physmap(uint64_t phys_end) {
     terminal_writestring("0x"); terminal_writestring(hex); terminal_writestring(" (fisico)\n");
 }
 
-// Zero out entire physical frame
-static void zero_frame(uint64_t phys) {
-    uint8_t* p;
-    if (physmap_initialized) {
-        p = (uint8_t*)phys_to_virt(phys);
-    } else {
-    // Identity fallback: works while early frames are identity mapped
-        p = (uint8_t*)phys;
-    }
-    for (int i = 0; i < PAGE_SIZE; i++) p[i] = 0;
-}
-
 static inline uint64_t read_cr3(void) {
     uint64_t val; __asm__ volatile("mov %%cr3, %0" : "=r"(val)); return val;
 }
 static inline void write_cr3(uint64_t val) {
     __asm__ volatile("mov %0, %%cr3" :: "r"(val));
 }
+static inline uint64_t read_cr4(void) {
+    uint64_t val; __asm__ volatile("mov %%cr4, %0" : "=r"(val)); return val;
+}
+static inline void write_cr4(uint64_t val) {
+    __asm__ volatile("mov %0, %%cr4" :: "r"(val) : "memory");
+}
+
+// ---- TLB tagging (PCID) and global kernel mappings ----
+// Kernel mappings (physmap, heap, kernel image) carry VMM_FLAG_GLOBAL and survive CR3
+// loads once CR4.PGE is on. With CR4.PCIDE every user space gets a 12-bit PCID and CR3 is
+// loaded with the no-flush bit, so its TLB entries survive switches. PCIDs are handed out
+// per generation: when they run out the generation advances, the whole TLB is flushed
+// once and spaces pick a fresh PCID on their next switch.
+#define CR4_PGE     (1ULL << 7)
+#define CR4_PCIDE   (1ULL << 17)
+#define CR3_NOFLUSH (1ULL << 63)
+#define PCID_MAX    4095
+static int pge_enabled = 0;
+static int pcid_enabled = 0;
+static int invpcid_enabled = 0;
+static uint64_t pcid_generation = 1;
+static uint16_t pcid_next = 1; // 0 is the kernel space
+
+// Drop every TLB entry, global ones and all PCIDs included (toggling CR4.PGE does that)
+static void tlb_flush_all(void) {
+    if (pge_enabled) {
+        uint64_t cr4 = read_cr4();
+        write_cr4(cr4 & ~CR4_PGE);
+        write_cr4(cr4);
+    } else {
+        write_cr3(read_cr3());
+    }
+}
+
+static inline int space_active(vmm_space_t* space) {
+    return (read_cr3() & ADDRESS_MASK) == (space->pml4_phys & ADDRESS_MASK);
+}
+
+// A translation of 'space' was removed or weakened: invlpg when the CPU can be using it
+// (active space, or kernel half shared by all), otherwise flush the PCID on its next switch
+static void space_flush_page(vmm_space_t* space, uint64_t virt) {
+    if ((virt >> 47) != 0 || space_active(space)) __asm__ volatile("invlpg (%0)" :: "r"(virt) : "memory");
+    else space->tlb_stale = 1;
+}
+
+// ---- TLB gather ----
+#define INVPCID_ADDR   0ULL // one address of one PCID
+#define INVPCID_SINGLE 1ULL // every non-global entry of one PCID
+#define INVPCID_ALL    2ULL // every entry, global ones included
+static void (*tlb_shootdown)(const vmm_tlb_gather_t* g) = NULL;
+
+static inline void invpcid(uint64_t type, uint64_t pcid, uint64_t addr) {
+    struct { uint64_t pcid; uint64_t addr; } __attribute__((aligned(16))) desc = { pcid, addr };
+    __asm__ volatile("invpcid %0, %1" :: "m"(desc), "r"(type) : "memory");
+}
+
+void vmm_set_tlb_shootdown(void (*fn)(const vmm_tlb_gather_t* g)) { tlb_shootdown = fn; }
+
+void vmm_tlb_gather_begin(vmm_tlb_gather_t* g, vmm_space_t* space) {
+    g->space = space ? space : &kernel_space;
+    g->nranges = 0;
+    g->global = (g->space == &kernel_space); // kernel image entries are global after boot
+    g->overflow = 0;
+    g->total_pages = 0;
+    g->nruns = g->nputs = g->ntables = 0;
+}
+
+// Contiguous additions extend the last range; past the table size only the count is kept
+void vmm_tlb_gather_add(vmm_tlb_gather_t* g, uint64_t virt, uint64_t npages) {
+    if (!npages) return;
+    virt &= ~(PAGE_SIZE - 1);
+    if ((virt >> 47) != 0) g->global = 1;
+    g->total_pages += npages;
+    if (g->nranges && g->start[g->nranges - 1] + g->pages[g->nranges - 1] * PAGE_SIZE == virt) {
+        g->pages[g->nranges - 1] += npages;
+    } else if (g->nranges < VMM_TLB_GATHER_RANGES) {
+        g->start[g->nranges] = virt;
+        g->pages[g->nranges] = npages;
+        g->nranges++;
+    } else {
+        g->overflow = 1;
+    }
+}
+
+// Flush the batch with one strategy:
+//  - visible (active space, or global entries involved): invlpg per page for small batches,
+//    otherwise INVPCID all/single-context or CR4.PGE toggle / CR3 reload;
+//  - inactive space with a live PCID and INVPCID: invalidate that PCID directly;
+//  - otherwise mark the space stale, its next switch flushes the PCID.
+static void gather_flush(vmm_tlb_gather_t* g) {
+    if (!g->total_pages) return;
+    vmm_space_t* space = g->space;
+    int small = !g->overflow && g->total_pages <= VMM_TLB_GATHER_PAGES;
+    if (g->global || space_active(space)) {
+        if (small) {
+            for (uint32_t r = 0; r < g->nranges; r++) {
+                for (uint64_t i = 0; i < g->pages[r]; i++) {
+                    __asm__ volatile("invlpg (%0)" :: "r"(g->start[r] + i * PAGE_SIZE) : "memory");
+                }
+            }
+        } else if (g->global) {
+            if (invpcid_enabled) invpcid(INVPCID_ALL, 0, 0);
+            else tlb_flush_all();
+        } else if (invpcid_enabled) {
+            invpcid(INVPCID_SINGLE, pcid_enabled ? (read_cr3() & 0xFFF) : 0, 0);
+        } else {
+            write_cr3(read_cr3()); // current PCID only (no-flush bit clear)
+        }
+    } else if (invpcid_enabled && pcid_enabled && space->pcid_gen == pcid_generation) {
+        if (small) {
+            for (uint32_t r = 0; r < g->nranges; r++) {
+                for (uint64_t i = 0; i < g->pages[r]; i++) invpcid(INVPCID_ADDR, space->pcid, g->start[r] + i * PAGE_SIZE);
+            }
+        } else {
+            invpcid(INVPCID_SINGLE, space->pcid, 0);
+        }
+    } else {
+        space->tlb_stale = 1;
+    }
+    // SMP: other CPUs may cache the same entries, one IPI per batch
+    if (tlb_shootdown) tlb_shootdown(g);
+}
+
+static void free_table_frame(uint64_t phys);
+
+// Deferred frees: no CPU holds a translation to these frames any more
+static void gather_release(vmm_tlb_gather_t* g) {
+    for (uint32_t i = 0; i < g->nruns; i++) pmm_free_frames((void*)g->run_start[i], g->run_count[i]);
+    for (uint32_t i = 0; i < g->nputs; i++) pmm_page_put(g->put[i]);
+    for (uint32_t i = 0; i < g->ntables; i++) free_table_frame(g->table[i]);
+    g->nruns = g->nputs = g->ntables = 0;
+}
+
+// A free list is full: flush and release now. The ranges stay queued, since the caller
+// keeps clearing entries inside them, and are flushed again on close.
+static void gather_make_room(vmm_tlb_gather_t* g) {
+    gather_flush(g);
+    gather_release(g);
+}
+
+// Leaf frame whose entry the batch cleared. Frames owned by this space alone (refcount 1,
+// not pinned) join runs freed with one pmm_free_frames() (large aligned blocks straight
+// into the buddy lists); shared copy-on-write or pinned frames just drop a reference.
+// g = NULL: tables never loaded by any CPU, released at once.
+static void gather_free_leaf(vmm_tlb_gather_t* g, uint64_t phys) {
+    if (!g) { pmm_page_put(phys); return; }
+    pmm_page_t* pg = pmm_page(phys);
+    if (!pg || pg->refcount != 1 || (pg->flags & PMM_PAGE_PINNED)) {
+        if (g->nputs == VMM_TLB_GATHER_PUTS) gather_make_room(g);
+        g->put[g->nputs++] = phys;
+        return;
+    }
+    if (g->nruns && phys == g->run_start[g->nruns - 1] + g->run_count[g->nruns - 1] * PAGE_SIZE) {
+        g->run_count[g->nruns - 1]++;
+        return;
+    }
+    if (g->nruns == VMM_TLB_GATHER_RUNS) gather_make_room(g);
+    g->run_start[g->nruns] = phys;
+    g->run_count[g->nruns++] = 1;
+}
+
+// Page-table frame the batch unlinked (paging-structure caches may still point to it)
+static void gather_free_table(vmm_tlb_gather_t* g, uint64_t phys) {
+    if (!g) { free_table_frame(phys); return; }
+    if (g->ntables == VMM_TLB_GATHER_TABLES) gather_make_room(g);
+    g->table[g->ntables++] = phys;
+}
+
+// Close the batch: flush, shootdown, then free what it unmapped
+void vmm_tlb_gather_end(vmm_tlb_gather_t* g) {
+    gather_flush(g);
+    gather_release(g);
+    g->nranges = 0;
+    g->total_pages = 0;
+    g->overflow = 0;
+}
 
-// Walk page table level or create if absent
+// Drop the boot identity map above what still needs it: the kernel image (linked at 2MB
+// and executed there), the early PMM metadata carved after it and the first 16MB (VGA
+// text buffer, low framebuffers). Everything else is reached through the physmap, so the
+// rest of the 512MB window only risked stray accesses going unnoticed. Shared by every
+// address space: user PML4s copy the kernel's PML4 entry of the identity PDPT.
+void vmm_trim_identity_map(void) {
+    if (!physmap_initialized) return;
+    const uint64_t HUGE_SIZE = 2ULL * 1024 * 1024;
+    uint64_t keep = pmm_get_reserved_end();
+    if (keep < PMM_ZONE_DMA_LIMIT) keep = PMM_ZONE_DMA_LIMIT;
+    keep = (keep + HUGE_SIZE - 1) & ~(HUGE_SIZE - 1);
+    uint64_t* pml4 = table_ptr(kernel_space.pml4_phys);
+    if (!(pml4[0] & VMM_FLAG_PRESENT)) return;
+    uint64_t* pdpt = table_ptr(pml4[0]);
+    if (!(pdpt[0] & VMM_FLAG_PRESENT) || (pdpt[0] & VMM_FLAG_PS)) return;
+    uint64_t* pdt = table_ptr(pdpt[0]);
+    // The kept part holds the running kernel: global, so it survives address space switches
+    for (uint64_t a = 0; a < keep; a += HUGE_SIZE) {
+        uint64_t* pde = &pdt[(a >> 21) & 0x1FF];
+        if (!(*pde & VMM_FLAG_PRESENT)) continue;
+        if (*pde & VMM_FLAG_PS) { *pde |= VMM_FLAG_GLOBAL; continue; }
+        uint64_t* pt = table_ptr(*pde);
+        for (int i = 0; i < PT_ENTRIES; i++) if (pt[i] & VMM_FLAG_PRESENT) pt[i] |= VMM_FLAG_GLOBAL;
+    }
+    for (uint64_t a = keep; a < PMM_IDENTITY_LIMIT; a += HUGE_SIZE) {
+        int pdt_i = (a >> 21) & 0x1FF;
+        // Only boot 2MB identity entries: split kernel ranges keep their page tables
+        if ((pdt[pdt_i] & (VMM_FLAG_PRESENT | VMM_FLAG_PS)) != (VMM_FLAG_PRESENT | VMM_FLAG_PS)) continue;
+        if ((pdt[pdt_i] & ADDRESS_MASK) != a) continue;
+        pdt[pdt_i] = 0;
+    }
+    tlb_flush_all();
+    terminal_writestring("[OK] Identity map trimmed to ");
+    char hex[17]; hex[16]='\0'; uint64_t v=keep; char hc[]="0123456789ABCDEF"; for(int i=15;i>=0;i--){ hex[i]=hc[v & 0xF]; v >>=4; }
+    terminal_writestring("0x"); terminal_writestring(hex); terminal_writestring(" (fisico)\n");
+}
+
+// Walk page table level or create if absent (tables reached through table_ptr)
 static uint64_t* get_or_create_table(uint64_t* table, int index, uint64_t flags) {
     uint64_t entry = table[index];
     if (!(entry & VMM_FLAG_PRESENT)) {
-        void* frame = pmm_alloc_frame();
+        void* frame = alloc_table_frame();
         if (!frame) return NULL;
-        zero_frame((uint64_t)frame);
         uint64_t phys = (uint64_t)frame & ADDRESS_MASK;
         table[index] = phys | (flags & (VMM_FLAG_RW|VMM_FLAG_USER|VMM_FLAG_PWT|VMM_FLAG_PCD)) | VMM_FLAG_PRESENT;
-        return (uint64_t*)phys; // Identity assumption
+        return table_ptr(phys);
     }
-    return (uint64_t*)(entry & ADDRESS_MASK);
+    return table_ptr(entry);
 }
 
-// Get pointer to final PT level for virtual address in given space
-static uint64_t* get_pt_space(vmm_space_t* space, uint64_t virt, int create, uint64_t flags) {
-    uint64_t pml4_phys = space->pml4_phys & ADDRESS_MASK;
-    uint64_t* pml4 = (uint64_t*)pml4_phys; // Identity assumption
+// Get pointer to the PDT (2MB level) covering virt in given space
+static uint64_t* get_pdt_space(vmm_space_t* space, uint64_t virt, int create, uint64_t flags) {
+    uint64_t* pml4 = table_ptr(space->pml4_phys);
 
     int pml4_i = (virt >> 39) & 0x1FF;
     int pdpt_i = (virt >> 30) & 0x1FF;
-    int pdt_i  = (virt >> 21) & 0x1FF;
-    int pt_i   = (virt >> 12) & 0x1FF;
 
-    uint64_t* pdpt = (uint64_t*)(pml4[pml4_i] & ADDRESS_MASK);
+    uint64_t* pdpt = table_ptr(pml4[pml4_i]);
     if (!(pml4[pml4_i] & VMM_FLAG_PRESENT)) {
         if (!create) return NULL;
         pdpt = get_or_create_table(pml4, pml4_i, flags);
         if (!pdpt) return NULL;
     }
-    uint64_t* pdt = (uint64_t*)(pdpt[pdpt_i] & ADDRESS_MASK);
+    uint64_t* pdt = table_ptr(pdpt[pdpt_i]);
     if (!(pdpt[pdpt_i] & VMM_FLAG_PRESENT)) {
         if (!create) return NULL;
         pdt = get_or_create_table(pdpt, pdpt_i, flags);
         if (!pdt) return NULL;
     }
-    uint64_t* pt = (uint64_t*)(pdt[pdt_i] & ADDRESS_MASK);
+    return pdt;
+}
+
+// Get pointer to final PT level for virtual address in given space
+static uint64_t* get_pt_space(vmm_space_t* space, uint64_t virt, int create, uint64_t flags) {
+    int pdt_i  = (virt >> 21) & 0x1FF;
+    int pt_i   = (virt >> 12) & 0x1FF;
+    uint64_t* pdt = get_pdt_space(space, virt, create, flags);
+    if (!pdt) return NULL;
+    if (pdt[pdt_i] & VMM_FLAG_PS) return NULL; // 2MB page: no PT below
+    uint64_t* pt = table_ptr(pdt[pdt_i]);
     if (!(pdt[pdt_i] & VMM_FLAG_PRESENT)) {
         if (!create) return NULL;
         pt = get_or_create_table(pdt, pdt_i, flags);
@@ -135,6 +365,9 @@ static uint64_t* get_pt(uint64_t virt, int create, uint64_t flags) { return get_
 
 void vmm_init(void) {
     kernel_space.pml4_phys = read_cr3();
+    // CR0.WP: supervisor writes honour read-only PTEs too (copy-on-write pages)
+    uint64_t cr0; __asm__ volatile("mov %%cr0, %0" : "=r"(cr0));
+    __asm__ volatile("mov %0, %%cr0" :: "r"(cr0 | (1ULL << 16)) : "memory");
     terminal_writestring("[OK] VMM init (CR3= ");
     uint64_t cr3 = kernel_space.pml4_phys; // Already physical
     char hex_chars[] = "0123456789ABCDEF"; char buf[17]; buf[16]='\0';
@@ -154,21 +387,19 @@ static inline uint64_t align_up_4k(uint64_t v) { return (v + 0xFFFULL) & ~0xFFFU
 
 // Retrieve PDT entry for identity-mapped virtual address (<16MB) and create page table if huge
 static uint64_t* ensure_pt_for_identity(uint64_t virt_base_2mb) {
-    uint64_t pml4_phys = kernel_space.pml4_phys & ADDRESS_MASK;
-    uint64_t* pml4 = (uint64_t*)pml4_phys;
+    uint64_t* pml4 = table_ptr(kernel_space.pml4_phys);
     int pml4_i = (virt_base_2mb >> 39) & 0x1FF;
-    uint64_t* pdpt = (uint64_t*)(pml4[pml4_i] & ADDRESS_MASK);
+    uint64_t* pdpt = table_ptr(pml4[pml4_i]);
     if (!(pml4[pml4_i] & VMM_FLAG_PRESENT)) return NULL; // should exist
     int pdpt_i = (virt_base_2mb >> 30) & 0x1FF;
-    uint64_t* pdt = (uint64_t*)(pdpt[pdpt_i] & ADDRESS_MASK);
+    uint64_t* pdt = table_ptr(pdpt[pdpt_i]);
     if (!(pdpt[pdpt_i] & VMM_FLAG_PRESENT)) return NULL;
     int pdt_i = (virt_base_2mb >> 21) & 0x1FF;
     uint64_t entry = pdt[pdt_i];
     if (entry & VMM_FLAG_PS) {
-    void* frame = pmm_alloc_frame(); if (!frame) { terminal_writestring("[ERR] alloc PT fail\n"); return NULL; }
-        zero_frame((uint64_t)frame);
+    void* frame = alloc_table_frame(); if (!frame) { terminal_writestring("[ERR] alloc PT fail\n"); return NULL; }
         uint64_t phys_base = (entry & ADDRESS_MASK);
-        uint64_t* pt = (uint64_t*)(((uint64_t)frame) & ADDRESS_MASK);
+        uint64_t* pt = table_ptr((uint64_t)frame);
         for (int i=0;i<512;i++) {
             uint64_t phys = phys_base + (i * PAGE_SIZE);
             // Permissive default: RW + executable; restrictions applied later.
@@ -177,10 +408,10 @@ static uint64_t* ensure_pt_for_identity(uint64_t virt_base_2mb) {
     pdt[pdt_i] = ((uint64_t)frame & ADDRESS_MASK) | VMM_FLAG_PRESENT | VMM_FLAG_RW; // clear PS (remove huge)
         return pt;
     }
-    return (uint64_t*)(entry & ADDRESS_MASK);
+    return table_ptr(entry);
 }
 
-static void set_page_flags(uint64_t virt, uint64_t flags_mask_clear, uint64_t flags_set) {
+static void set_page_flags(vmm_tlb_gather_t* g, uint64_t virt, uint64_t flags_mask_clear, uint64_t flags_set) {
     // Ensure the 2MB chunk is split into 4K pages
     ensure_pt_for_identity(virt & ~((2ULL*1024*1024)-1));
     uint64_t* pt = get_pt(virt, 0, 0);
@@ -191,7 +422,7 @@ static void set_page_flags(uint64_t virt, uint64_t flags_mask_clear, uint64_t fl
     entry &= ~flags_mask_clear;
     entry |= flags_set;
     pt[pt_i] = entry;
-    __asm__ volatile("invlpg (%0)" :: "r"(virt) : "memory");
+    vmm_tlb_gather_add(g, virt, 1);
 }
 
 void vmm_protect_kernel_sections(void) {
@@ -221,25 +452,29 @@ void vmm_protect_kernel_sections(void) {
         ensure_pt_for_identity(cur);
     }
 
+    // One TLB batch for the whole image: a single flush instead of one invlpg per page
+    vmm_tlb_gather_t g;
+    vmm_tlb_gather_begin(&g, &kernel_space);
     // Text: RX (clear RW & NX)
     for (uint64_t v = align_down(text_start); v < align_up_4k(text_end); v += PAGE_SIZE) {
-        set_page_flags(v, VMM_FLAG_RW | VMM_FLAG_NOEXEC, 0); // clear RW & NX
+        set_page_flags(&g, v, VMM_FLAG_RW | VMM_FLAG_NOEXEC, 0); // clear RW & NX
     }
     // Rodata: R, NX
     for (uint64_t v = align_down(ro_start); v < align_up_4k(ro_end); v += PAGE_SIZE) {
-        set_page_flags(v, VMM_FLAG_RW, VMM_FLAG_NOEXEC); // remove RW, set NX
+        set_page_flags(&g, v, VMM_FLAG_RW, VMM_FLAG_NOEXEC); // remove RW, set NX
     }
     // Data + BSS: RW, NX
     for (uint64_t v = align_down(data_start); v < align_up_4k(data_end); v += PAGE_SIZE) {
-        set_page_flags(v, VMM_FLAG_NOEXEC, VMM_FLAG_NOEXEC | VMM_FLAG_RW); // enforce NX & RW
+        set_page_flags(&g, v, VMM_FLAG_NOEXEC, VMM_FLAG_NOEXEC | VMM_FLAG_RW); // enforce NX & RW
     }
     for (uint64_t v = align_down(bss_start); v < align_up_4k(bss_end); v += PAGE_SIZE) {
-        set_page_flags(v, VMM_FLAG_NOEXEC, VMM_FLAG_NOEXEC | VMM_FLAG_RW);
+        set_page_flags(&g, v, VMM_FLAG_NOEXEC, VMM_FLAG_NOEXEC | VMM_FLAG_RW);
     }
     // Stack: RW, NX (guard page deferred for stability)
     for (uint64_t v = align_down(stack_btm); v < align_up_4k(stack_tp); v += PAGE_SIZE) {
-        set_page_flags(v, VMM_FLAG_NOEXEC, VMM_FLAG_NOEXEC | VMM_FLAG_RW);
+        set_page_flags(&g, v, VMM_FLAG_NOEXEC, VMM_FLAG_NOEXEC | VMM_FLAG_RW);
     }
+    vmm_tlb_gather_end(&g);
 
     terminal_writestring("[SEC] W^X applied: text RX, rodata R/NX, data+bss RW/NX, stack RW/NX with guard page\n");
 }
@@ -247,8 +482,7 @@ void vmm_protect_kernel_sections(void) {
 // ---- User space helpers ----
 static int map_user_page(uint64_t virt, int rw, int exec) {
     if (virt & 0xFFF) return -1;
-    void* frame = pmm_alloc_frame(); if (!frame) return -2;
-    zero_frame((uint64_t)frame);
+    void* frame = pmm_alloc_zeroed_frame(); if (!frame) return -2;
     uint64_t flags = VMM_FLAG_PRESENT | VMM_FLAG_USER;
     if (rw) flags |= VMM_FLAG_RW;
     if (!exec) flags |= VMM_FLAG_NOEXEC;
@@ -265,8 +499,9 @@ static int map_user_page(uint64_t virt, int rw, int exec) {
 static int map_user_page_in_space(vmm_space_t* space, uint64_t virt, int rw, int exec) {
     if (!space) return -10;
     if (virt & 0xFFF) return -1;
-    void* frame = pmm_alloc_frame(); if (!frame) return -2;
-    zero_frame((uint64_t)frame);
+    // Coloured spaces only get frames whose LLC colour is in their mask
+    void* frame = space->colour_mask ? pmm_alloc_coloured_frame(space->colour_mask) : pmm_alloc_zeroed_frame();
+    if (!frame) return -2;
     uint64_t flags = VMM_FLAG_PRESENT | VMM_FLAG_USER;
     if (rw) flags |= VMM_FLAG_RW;
     if (!exec) flags |= VMM_FLAG_NOEXEC;
@@ -297,12 +532,9 @@ uint64_t vmm_alloc_user_stack(int pages) {
     if (pages <= 0) pages = 4;
     uint64_t top = USER_STACK_TOP;
     // Leave one unmapped guard page below bottom (top - pages*PAGE_SIZE - PAGE_SIZE)
-    for (int i=0;i<pages;i++) {
-        uint64_t page_addr = top - (i+1)*PAGE_SIZE;
-        if (vmm_alloc_user_page(page_addr) != 0) {
-            terminal_writestring("[USER] alloc stack page fail\n");
-            break;
-        }
+    if (vmm_map_range(&kernel_space, top - (uint64_t)pages * PAGE_SIZE, VMM_MAP_ALLOC, (uint64_t)pages,
+                      VMM_FLAG_USER | VMM_FLAG_RW | VMM_FLAG_NOEXEC) != 0) {
+        terminal_writestring("[USER] alloc stack page fail\n");
     }
     return top;
 }
@@ -311,70 +543,245 @@ uint64_t vmm_alloc_user_stack_in_space(vmm_space_t* space, int pages) {
     if (!space) return 0;
     if (pages <= 0) pages = 4;
     uint64_t top = USER_STACK_TOP;
-    // Guard page: don't map page immediately below stack bottom
-    for (int i=0;i<pages;i++) {
-        uint64_t page_addr = top - (i+1)*PAGE_SIZE;
-        if (vmm_alloc_user_page_in_space(space, page_addr) != 0) {
-            terminal_writestring("[USER] alloc stack page fail (space)\n");
-            break;
-        }
+    // Lazy: only a VMA, pages are faulted in on first touch. The guard page below the
+    // bottom stays outside the VMA, so an overflow still ends in an unhandled fault.
+    if (vmm_vma_add(space, top - (uint64_t)pages * PAGE_SIZE, (uint64_t)pages * PAGE_SIZE,
+                    VMM_FLAG_USER | VMM_FLAG_RW | VMM_FLAG_NOEXEC) != 0) {
+        terminal_writestring("[USER] alloc stack VMA fail (space)\n");
     }
     return top;
 }
 
+// Give back a table frame whose entries are all zero: to the pool, or the PMM when full
+static void free_table_frame(uint64_t phys) {
+    phys &= ADDRESS_MASK;
+    if (table_pool_count < TABLE_POOL_MAX) { table_pool[table_pool_count++] = phys; return; }
+    pmm_page_clear_flags(phys, PMM_PAGE_TABLE);
+    pmm_free_frame((void*)phys);
+}
+
+// Free a PDT of the user half and everything below it, zeroing entries on the way and
+// skipping empty entries; the frames are queued in g (freed after its flush). The caller
+// has already added the covered range to g. Returns the number of 4KB pages unmapped.
+static uint64_t teardown_pdt(uint64_t pdt_phys, vmm_tlb_gather_t* g) {
+    uint64_t* pdt = table_ptr(pdt_phys);
+    uint64_t pages = 0;
+    for (int i = 0; i < PT_ENTRIES; i++) {
+        uint64_t pde = pdt[i];
+        if (!(pde & VMM_FLAG_PRESENT)) { pdt[i] = 0; continue; }
+        if (pde & VMM_FLAG_PS) {
+            uint64_t base = pde & ADDRESS_MASK & ~(HUGE_PAGE_SIZE - 1);
+            for (int k = 0; k < HUGE_PAGE_FRAMES; k++) gather_free_leaf(g, base + (uint64_t)k * PAGE_SIZE);
+            pages += HUGE_PAGE_FRAMES;
+        } else {
+            uint64_t* pt = table_ptr(pde);
+            for (int j = 0; j < PT_ENTRIES; j++) {
+                if (pt[j] & VMM_FLAG_PRESENT) { gather_free_leaf(g, pt[j] & ADDRESS_MASK); pages++; }
+                pt[j] = 0;
+            }
+            gather_free_table(g, pde & ADDRESS_MASK);
+        }
+        pdt[i] = 0;
+    }
+    gather_free_table(g, pdt_phys);
+    return pages;
+}
+
+// Single pass over the user half of a space: every private PDPT/PDT/PT goes back to the
+// table pool, every leaf frame drops its reference, then the PML4 itself.
+// A PDPT index is private when it covers the user range (zeroed at creation) or when the
+// kernel has no PDPT in that slot; other entries equal to the kernel's are shared and kept.
+// Frames are freed when g closes (whole-context flush of the space); g = NULL only for a
+// PML4 that was never loaded, whose frames go back at once.
+static void space_teardown(uint64_t pml4_phys, vmm_tlb_gather_t* g) {
+    if (g) vmm_tlb_gather_add(g, USER_CODE_BASE, (USER_STACK_TOP - USER_CODE_BASE) / PAGE_SIZE);
+    uint64_t* pml4 = table_ptr(pml4_phys);
+    uint64_t* kpml4 = table_ptr(kernel_space.pml4_phys);
+    for (int i = 0; i < PT_ENTRIES / 2; i++) { // kernel half: shared, never freed here
+        uint64_t e = pml4[i];
+        if (!(e & VMM_FLAG_PRESENT)) continue;
+        if ((e & ADDRESS_MASK) == (kpml4[i] & ADDRESS_MASK)) continue; // kernel PDPT
+        uint64_t* pdpt = table_ptr(e);
+        uint64_t* kpdpt = (kpml4[i] & VMM_FLAG_PRESENT) ? table_ptr(kpml4[i]) : NULL;
+        for (int j = 0; j < PT_ENTRIES; j++) {
+            uint64_t pdpte = pdpt[j];
+            pdpt[j] = 0;
+            if (!(pdpte & VMM_FLAG_PRESENT) || (pdpte & VMM_FLAG_PS)) continue;
+            uint64_t gb = ((uint64_t)i << 39) | ((uint64_t)j << 30);
+            int user = gb + (1ULL << 30) > USER_CODE_BASE && gb < USER_STACK_TOP;
+            if (!user && kpdpt) continue; // copied from the kernel PDPT
+            teardown_pdt(pdpte & ADDRESS_MASK, g);
+        }
+        gather_free_table(g, e & ADDRESS_MASK);
+    }
+    for (int i = 0; i < PT_ENTRIES; i++) pml4[i] = 0;
+    gather_free_table(g, pml4_phys);
+}
+
+// Unmap the whole user range of a live space in one descent: per 1GB window the PDT
+// subtree goes (leaves, PTs, PDT), empty windows are skipped, and the TLB is flushed once
+// at the end, before any of those frames is freed. VMAs stay, so touched areas fault back
+// in as zero pages.
+uint64_t vmm_unmap_user(vmm_space_t* space) {
+    if (!space || space == &kernel_space) return 0;
+    vmm_tlb_gather_t g;
+    vmm_tlb_gather_begin(&g, space);
+    uint64_t pages = 0;
+    uint64_t* pml4 = table_ptr(space->pml4_phys);
+    for (uint64_t gb = USER_CODE_BASE & ~((1ULL << 30) - 1); gb < USER_STACK_TOP; gb += (1ULL << 30)) {
+        uint64_t pml4e = pml4[(gb >> 39) & 0x1FF];
+        if (!(pml4e & VMM_FLAG_PRESENT)) continue;
+        uint64_t* pdpte = &table_ptr(pml4e)[(gb >> 30) & 0x1FF];
+        if (!(*pdpte & VMM_FLAG_PRESENT) || (*pdpte & VMM_FLAG_PS)) continue;
+        uint64_t pdt_phys = *pdpte & ADDRESS_MASK;
+        *pdpte = 0;
+        vmm_tlb_gather_add(&g, gb, (1ULL << 30) / PAGE_SIZE);
+        pages += teardown_pdt(pdt_phys, &g);
+    }
+    vmm_tlb_gather_end(&g);
+    return pages;
+}
+
+// Resident 4KB pages of the user range (a 2MB page counts 512); owner != 0 also tags
+// every resident frame with it (struct page owner)
+uint64_t vmm_space_resident(vmm_space_t* space, uint32_t owner) {
+    if (!space) return 0;
+    uint64_t pages = 0;
+    uint64_t* pml4 = table_ptr(space->pml4_phys);
+    for (uint64_t gb = USER_CODE_BASE & ~((1ULL << 30) - 1); gb < USER_STACK_TOP; gb += (1ULL << 30)) {
+        uint64_t pml4e = pml4[(gb >> 39) & 0x1FF];
+        if (!(pml4e & VMM_FLAG_PRESENT)) continue;
+        uint64_t pdpte = table_ptr(pml4e)[(gb >> 30) & 0x1FF];
+        if (!(pdpte & VMM_FLAG_PRESENT) || (pdpte & VMM_FLAG_PS)) continue;
+        uint64_t* pdt = table_ptr(pdpte);
+        for (int i = 0; i < PT_ENTRIES; i++) {
+            uint64_t pde = pdt[i];
+            if (!(pde & VMM_FLAG_PRESENT)) continue;
+            if (pde & VMM_FLAG_PS) {
+                uint64_t base = pde & ADDRESS_MASK & ~(HUGE_PAGE_SIZE - 1);
+                if (owner) for (int k = 0; k < HUGE_PAGE_FRAMES; k++) pmm_page_set_owner(base + (uint64_t)k * PAGE_SIZE, owner);
+                pages += HUGE_PAGE_FRAMES;
+                continue;
+            }
+            uint64_t* pt = table_ptr(pde);
+            for (int j = 0; j < PT_ENTRIES; j++) {
+                if (!(pt[j] & VMM_FLAG_PRESENT)) continue;
+                if (owner) pmm_page_set_owner(pt[j] & ADDRESS_MASK, owner);
+                pages++;
+            }
+        }
+    }
+    return pages;
+}
+
+// Sum of the struct page refcounts of the resident user frames (leak checks: a failed
+// clone must leave the parent's sum unchanged)
+uint64_t vmm_space_refs(vmm_space_t* space) {
+    if (!space) return 0;
+    uint64_t refs = 0;
+    uint64_t* pml4 = table_ptr(space->pml4_phys);
+    for (uint64_t gb = USER_CODE_BASE & ~((1ULL << 30) - 1); gb < USER_STACK_TOP; gb += (1ULL << 30)) {
+        uint64_t pml4e = pml4[(gb >> 39) & 0x1FF];
+        if (!(pml4e & VMM_FLAG_PRESENT)) continue;
+        uint64_t pdpte = table_ptr(pml4e)[(gb >> 30) & 0x1FF];
+        if (!(pdpte & VMM_FLAG_PRESENT) || (pdpte & VMM_FLAG_PS)) continue;
+        uint64_t* pdt = table_ptr(pdpte);
+        for (int i = 0; i < PT_ENTRIES; i++) {
+            uint64_t pde = pdt[i];
+            if (!(pde & VMM_FLAG_PRESENT)) continue;
+            if (pde & VMM_FLAG_PS) {
+                uint64_t base = pde & ADDRESS_MASK & ~(HUGE_PAGE_SIZE - 1);
+                for (int k = 0; k < HUGE_PAGE_FRAMES; k++) refs += pmm_page_refcount(base + (uint64_t)k * PAGE_SIZE);
+                continue;
+            }
+            uint64_t* pt = table_ptr(pde);
+            for (int j = 0; j < PT_ENTRIES; j++) {
+                if (pt[j] & VMM_FLAG_PRESENT) refs += pmm_page_refcount(pt[j] & ADDRESS_MASK);
+            }
+        }
+    }
+    return refs;
+}
+
 vmm_space_t* vmm_space_create_user(void) {
-    void* pml4_new = pmm_alloc_frame(); if (!pml4_new) return NULL;
-    zero_frame((uint64_t)pml4_new);
-    uint64_t* old_pml4 = (uint64_t*)(kernel_space.pml4_phys & ADDRESS_MASK);
-    uint64_t* new_pml4 = (uint64_t*)((uint64_t)pml4_new & ADDRESS_MASK);
+    void* pml4_new = alloc_table_frame(); if (!pml4_new) return NULL;
+    uint64_t* old_pml4 = table_ptr(kernel_space.pml4_phys);
+    uint64_t* new_pml4 = table_ptr((uint64_t)pml4_new);
     for (int i=0;i<PT_ENTRIES;i++) {
         uint64_t e = old_pml4[i];
         if (e & VMM_FLAG_PRESENT) new_pml4[i] = e & ~VMM_FLAG_USER; // share kernel mappings
     }
-    // Clear 1GB blocks for user space (CODE/DATA/STACK) to avoid collisions with identity mapping
-    // Iterate in 1GB intervals using PDPT index
+    // Clear 1GB blocks for user space (CODE/DATA/STACK) to avoid collisions with identity mapping.
+    // A PML4 slot covering the user range gets a private copy of the kernel PDPT first, so
+    // user tables never land in (or get wiped from) the PDPT shared with the kernel and
+    // with every other space. Iterate in 1GB intervals using PDPT index.
     uint64_t start_usr = USER_CODE_BASE;
     uint64_t end_usr   = USER_STACK_TOP;
     for (uint64_t addr = start_usr; addr < end_usr; addr += (1ULL<<30)) { // step 1GB
         int pml4_i = (addr >> 39) & 0x1FF; // tipicamente 0 per indirizzi bassi < 512GB
-        uint64_t pdpt_phys = new_pml4[pml4_i] & ADDRESS_MASK;
-    if (!(new_pml4[pml4_i] & VMM_FLAG_PRESENT)) continue; // no PDPT
-        uint64_t* pdpt = (uint64_t*)pdpt_phys;
+    if (!(new_pml4[pml4_i] & VMM_FLAG_PRESENT)) continue; // no PDPT: created private on demand
+        if ((new_pml4[pml4_i] & ADDRESS_MASK) == (old_pml4[pml4_i] & ADDRESS_MASK)) {
+            void* frame = alloc_table_frame();
+            if (!frame) { space_teardown((uint64_t)pml4_new, NULL); return NULL; }
+            uint64_t* src = table_ptr(old_pml4[pml4_i]);
+            uint64_t* dst = table_ptr((uint64_t)frame);
+            for (int i=0;i<PT_ENTRIES;i++) dst[i] = src[i];
+            new_pml4[pml4_i] = ((uint64_t)frame & ADDRESS_MASK) | (old_pml4[pml4_i] & ~ADDRESS_MASK) | VMM_FLAG_USER;
+        }
+        uint64_t* pdpt = table_ptr(new_pml4[pml4_i]);
         int pdpt_i = (addr >> 30) & 0x1FF;
     // If entry present, zero it: user space gets dedicated tables
         if (pdpt[pdpt_i] & VMM_FLAG_PRESENT) {
-            pdpt[pdpt_i] = 0; // rimuove huge o link a PDT esistente del kernel
+            pdpt[pdpt_i] = 0; // rimuove huge o link a PDT del kernel (solo nella copia privata)
         }
     }
-    vmm_space_t* space = (vmm_space_t*)kmalloc(sizeof(vmm_space_t));
-    if (!space) return NULL;
+    if (!space_cache) space_cache = kmem_cache_create("vmm_space", sizeof(vmm_space_t), 8, NULL);
+    vmm_space_t* space = (vmm_space_t*)kmem_cache_alloc(space_cache);
+    if (!space) { space_teardown((uint64_t)pml4_new, NULL); return NULL; }
     space->pml4_phys = (uint64_t)pml4_new & ADDRESS_MASK;
+    space->colour_mask = 0;
+    space->pcid_gen = 0; // PCID assigned on first switch
+    space->pcid = 0;
+    space->tlb_stale = 0;
+    space->vmas = NULL;
+    space->vma_count = 0;
     terminal_writestring("[USER] new address space CR3=");
     char hx[]="0123456789ABCDEF"; for(int i=60;i>=0;i-=4) terminal_putchar(hx[(space->pml4_phys>>i)&0xF]);
     terminal_writestring("\n");
     return space;
 }
 
+static void vma_free_tree(vmm_vma_t* v);
+
+// Destroy a user space: page tables and leaf frames (space_teardown), VMAs, descriptor.
+// The PML4 frame is freed here too, callers must not free it.
 int vmm_space_destroy(vmm_space_t* space) {
-    if (!space) return -1;
-    kfree(space);
+    if (!space || space == &kernel_space) return -1;
+    if (space_active(space)) vmm_switch_space(&kernel_space);
+    if (current_space == space) current_space = &kernel_space;
+    vmm_tlb_gather_t g;
+    vmm_tlb_gather_begin(&g, space);
+    space_teardown(space->pml4_phys, &g);
+    vmm_tlb_gather_end(&g); // before the descriptor goes: the shootdown still reads it
+    vma_free_tree(space->vmas);
+    kmem_cache_free(space_cache, space);
     return 0;
 }
 
 // Map all available physical memory using 2MB huge pages to reduce table count.
+// Covers up to the highest RAM address (not the RAM sum: holes below 4GB push RAM higher).
 void vmm_init_physmap(void) {
     if (physmap_initialized) return;
-    uint64_t total = pmm_get_total_memory();
+    uint64_t total = pmm_get_max_phys();
     if (total == 0) {
-    terminal_writestring("[WARN] physmap: total memory = 0\n");
+    terminal_writestring("[WARN] physmap: max phys = 0\n");
         return;
     }
     // Round up to 2MB multiples
     const uint64_t HUGE_SIZE = 2ULL * 1024 * 1024;
     uint64_t limit = (total + HUGE_SIZE - 1) & ~(HUGE_SIZE - 1);
 
-    uint64_t pml4_phys = kernel_space.pml4_phys & ADDRESS_MASK;
-    uint64_t* pml4 = (uint64_t*)pml4_phys; // identity assumption
+    uint64_t* pml4 = table_ptr(kernel_space.pml4_phys); // identity: the physmap is being built
 
     // Calculate PML4 / PDPT / PDT indices for physmap range
     // Using VMM_PHYSMAP_BASE: extract PML4 index
@@ -382,24 +789,22 @@ void vmm_init_physmap(void) {
     int pdpt_i_start = (VMM_PHYSMAP_BASE >> 30) & 0x1FF;
 
     // Ensure PDPT is present
-    uint64_t* pdpt = (uint64_t*)(pml4[pml4_i] & ADDRESS_MASK);
+    uint64_t* pdpt = table_ptr(pml4[pml4_i]);
     if (!(pml4[pml4_i] & VMM_FLAG_PRESENT)) {
-    void* frame = pmm_alloc_frame(); if (!frame) { terminal_writestring("[ERR] physmap: PDPT alloc fail\n"); return; }
-        zero_frame((uint64_t)frame);
+    void* frame = alloc_table_frame(); if (!frame) { terminal_writestring("[ERR] physmap: PDPT alloc fail\n"); return; }
         pml4[pml4_i] = ((uint64_t)frame & ADDRESS_MASK) | VMM_FLAG_PRESENT | VMM_FLAG_RW;
-        pdpt = (uint64_t*)(((uint64_t)frame) & ADDRESS_MASK);
+        pdpt = table_ptr((uint64_t)frame);
     }
 
     uint64_t phys_cursor = 0;
     while (phys_cursor < limit) {
     int pdpt_i = pdpt_i_start + ((phys_cursor >> 30) & 0x1FF); // Simple, should not exceed 512 early
     if (pdpt_i >= 512) { terminal_writestring("[WARN] physmap: exceeds PDPT range\n"); break; }
-        uint64_t* pdt = (uint64_t*)(pdpt[pdpt_i] & ADDRESS_MASK);
+        uint64_t* pdt = table_ptr(pdpt[pdpt_i]);
         if (!(pdpt[pdpt_i] & VMM_FLAG_PRESENT)) {
-            void* frame = pmm_alloc_frame(); if (!frame) { terminal_writestring("[ERR] physmap: PDT alloc fail\n"); break; }
-            zero_frame((uint64_t)frame);
+            void* frame = alloc_table_frame(); if (!frame) { terminal_writestring("[ERR] physmap: PDT alloc fail\n"); break; }
             pdpt[pdpt_i] = ((uint64_t)frame & ADDRESS_MASK) | VMM_FLAG_PRESENT | VMM_FLAG_RW;
-            pdt = (uint64_t*)(((uint64_t)frame) & ADDRESS_MASK);
+            pdt = table_ptr((uint64_t)frame);
         }
     // Fill PDT with huge pages
         for (int pdt_i = 0; pdt_i < 512 && phys_cursor < limit; pdt_i++) {
@@ -409,7 +814,7 @@ void vmm_init_physmap(void) {
             if (virt_pdt_i != pdt_i) continue; // Align with local index
             if (!(pdt[pdt_i] & VMM_FLAG_PRESENT)) {
                 // Mark physmap pages NX (non-executable) and RW
-                pdt[pdt_i] = (phys_cursor & ADDRESS_MASK) | VMM_FLAG_PRESENT | VMM_FLAG_RW | VMM_FLAG_PS | VMM_FLAG_NOEXEC;
+                pdt[pdt_i] = (phys_cursor & ADDRESS_MASK) | VMM_FLAG_PRESENT | VMM_FLAG_RW | VMM_FLAG_PS | VMM_FLAG_NOEXEC | VMM_FLAG_GLOBAL;
             }
             phys_cursor += HUGE_SIZE;
         }
@@ -442,79 +847,532 @@ int vmm_map_in_space(vmm_space_t* space, uint64_t virt, uint64_t phys, uint64_t
     return 0;
 }
 
-int vmm_unmap(uint64_t virt) {
+int vmm_unmap_gather(vmm_tlb_gather_t* g, uint64_t virt) {
     if (virt & 0xFFF) return -1; // not aligned
     uint64_t* pt = get_pt(virt, 0, 0);
     if (!pt) return -2;
     int pt_i = (virt >> 12) & 0x1FF;
     if (!(pt[pt_i] & VMM_FLAG_PRESENT)) return -3; // not mapped
     pt[pt_i] = 0;
-    // Invalidate TLB
-    __asm__ volatile("invlpg (%0)" :: "r"(virt) : "memory");
+    vmm_tlb_gather_add(g, virt, 1);
     return 0;
 }
 
+int vmm_unmap(uint64_t virt) {
+    vmm_tlb_gather_t g;
+    vmm_tlb_gather_begin(&g, &kernel_space);
+    int r = vmm_unmap_gather(&g, virt);
+    vmm_tlb_gather_end(&g);
+    return r;
+}
+
+static uint64_t* split_huge_pde(vmm_space_t* space, uint64_t* pde, uint64_t virt_2mb);
+
 int vmm_unmap_in_space(vmm_space_t* space, uint64_t virt) {
     if (!space) return -10;
     if (virt & 0xFFF) return -1; // not aligned
+    uint64_t* pdt = get_pdt_space(space, virt, 0, 0);
+    if (pdt && (pdt[(virt >> 21) & 0x1FF] & VMM_FLAG_PS)) {
+        // Single 4KB page out of a 2MB one: split it, the other 511 frames stay mapped
+        if (!split_huge_pde(space, &pdt[(virt >> 21) & 0x1FF], virt & ~(HUGE_PAGE_SIZE - 1))) return -4;
+    }
     uint64_t* pt = get_pt_space(space, virt, 0, 0);
     if (!pt) return -2;
     int pt_i = (virt >> 12) & 0x1FF;
     if (!(pt[pt_i] & VMM_FLAG_PRESENT)) return -3; // not mapped
     uint64_t entry = pt[pt_i];
     pt[pt_i] = 0;
-    // Free physical frame
-    void* frame = (void*)(entry & ADDRESS_MASK);
-    pmm_free_frame(frame);
+    space_flush_page(space, virt);
+    // Drop this mapping's reference: the frame is freed only if no other space shares it
+    pmm_page_put(entry & ADDRESS_MASK);
     return 0;
 }
 
+// ---- Range mapping ----
+// One table walk per 2MB: the PT pointer is reused until the PT index wraps. Intermediate
+// tables are created RW (the leaf entry carries the real protection) so a read-only code
+// range never makes a shared PDT read-only for later data pages.
+// 2MB user pages (VMM_MAP_HUGE) are a PS entry in the PDT over 512 contiguous frames from
+// one aligned buddy block. Every frame keeps its own struct page reference, so a huge page
+// can be split into a PT later and its frames released one by one.
+
+static inline uint64_t range_table_flags(uint64_t flags) {
+    return (flags & (VMM_FLAG_USER|VMM_FLAG_PWT|VMM_FLAG_PCD)) | VMM_FLAG_RW;
+}
+
+static uint64_t* range_pt(vmm_space_t* space, uint64_t virt, int create, uint64_t flags) {
+    return get_pt_space(space, virt, create, range_table_flags(flags));
+}
+
+// Frame for VMM_MAP_ALLOC: coloured spaces only get frames whose LLC colour is in their mask
+static void* range_frame(vmm_space_t* space) {
+    return space->colour_mask ? pmm_alloc_coloured_frame(space->colour_mask) : pmm_alloc_zeroed_frame();
+}
+
+// Zeroed, 2MB-aligned run of 512 frames (NULL if fragmentation leaves none)
+static uint64_t alloc_huge_frame(void) {
+    void* block = pmm_alloc_frames(HUGE_PAGE_FRAMES, HUGE_PAGE_SIZE);
+    if (!block) return 0;
+    void* p = (void*)phys_to_virt((uint64_t)block);
+    uint64_t cnt = HUGE_PAGE_SIZE / 8;
+    __asm__ volatile ("rep stosq" : "+D"(p), "+c"(cnt) : "a"(0ULL) : "memory");
+    return (uint64_t)block;
+}
+
+// Copy 'frames' physical frames through the physmap (copy-on-write faults)
+static void copy_frames(uint64_t dst_phys, uint64_t src_phys, uint64_t frames) {
+    void* d = (void*)phys_to_virt(dst_phys);
+    const void* sp = (const void*)phys_to_virt(src_phys);
+    uint64_t cnt = frames * PAGE_SIZE / 8;
+    __asm__ volatile ("rep movsq" : "+D"(d), "+S"(sp), "+c"(cnt) :: "memory");
+}
+
+// Replace a 2MB PS entry by a PT of 512 4KB entries with the same protection, so part of
+// the huge page can be unmapped. The old translation is dropped from the TLB when visible.
+static uint64_t* split_huge_pde(vmm_space_t* space, uint64_t* pde, uint64_t virt_2mb) {
+    void* frame = alloc_table_frame();
+    if (!frame) return NULL;
+    uint64_t* pt = table_ptr((uint64_t)frame);
+    uint64_t base = *pde & ADDRESS_MASK & ~(HUGE_PAGE_SIZE - 1);
+    uint64_t leaf = *pde & ~(ADDRESS_MASK | VMM_FLAG_PS);
+    for (int i = 0; i < PT_ENTRIES; i++) pt[i] = (base + (uint64_t)i * PAGE_SIZE) | leaf;
+    *pde = ((uint64_t)frame & ADDRESS_MASK) | range_table_flags(leaf) | VMM_FLAG_PRESENT;
+    space_flush_page(space, virt_2mb);
+    return pt;
+}
+
+// Clear the mappings of [virt, virt + npages pages); put_frames drops the frame references,
+// after the TLB batch is flushed. Whole 2MB pages go at once, partially covered ones are
+// split first.
+static uint64_t range_clear(vmm_space_t* space, uint64_t virt, uint64_t npages, int put_frames) {
+    uint64_t end = virt + npages * PAGE_SIZE;
+    uint64_t unmapped = 0;
+    vmm_tlb_gather_t g;
+    vmm_tlb_gather_begin(&g, space);
+    uint64_t va = virt;
+    while (va < end) {
+        uint64_t next_2mb = (va + HUGE_PAGE_SIZE) & ~(HUGE_PAGE_SIZE - 1);
+        if (next_2mb > end) next_2mb = end;
+        uint64_t* pdt = get_pdt_space(space, va, 0, 0);
+        if (!pdt) { va = next_2mb; continue; }
+        uint64_t* pde = &pdt[(va >> 21) & 0x1FF];
+        if ((*pde & (VMM_FLAG_PRESENT | VMM_FLAG_PS)) == (VMM_FLAG_PRESENT | VMM_FLAG_PS)) {
+            if (!(va & (HUGE_PAGE_SIZE - 1)) && va + HUGE_PAGE_SIZE <= end) {
+                uint64_t base = *pde & ADDRESS_MASK & ~(HUGE_PAGE_SIZE - 1);
+                *pde = 0;
+                if (!unmapped) vmm_tlb_gather_add(&g, virt, npages);
+                if (put_frames) for (int i = 0; i < HUGE_PAGE_FRAMES; i++) gather_free_leaf(&g, base + (uint64_t)i * PAGE_SIZE);
+                unmapped += HUGE_PAGE_FRAMES;
+                va = next_2mb;
+                continue;
+            }
+            if (!split_huge_pde(space, pde, va & ~(HUGE_PAGE_SIZE - 1))) { va = next_2mb; continue; }
+        }
+        if (!(*pde & VMM_FLAG_PRESENT)) { va = next_2mb; continue; }
+        uint64_t* pt = table_ptr(*pde);
+        for (; va < next_2mb; va += PAGE_SIZE) {
+            int pt_i = (va >> 12) & 0x1FF;
+            uint64_t entry = pt[pt_i];
+            if (!(entry & VMM_FLAG_PRESENT)) continue;
+            pt[pt_i] = 0;
+            if (!unmapped) vmm_tlb_gather_add(&g, virt, npages);
+            if (put_frames) gather_free_leaf(&g, entry & ADDRESS_MASK);
+            unmapped++;
+        }
+    }
+    vmm_tlb_gather_end(&g); // no-op when nothing was unmapped
+    return unmapped;
+}
+
+int vmm_map_range(vmm_space_t* space, uint64_t virt, uint64_t phys, uint64_t npages, uint64_t flags) {
+    if (!space) space = &kernel_space;
+    int alloc = (phys == VMM_MAP_ALLOC);
+    if (virt & 0xFFF || (!alloc && (phys & 0xFFF))) return -1; // not aligned
+    // A 2MB page spans every LLC colour: coloured spaces stay on 4KB frames
+    int huge = (flags & VMM_MAP_HUGE) && !(alloc && space->colour_mask);
+    flags &= ~(VMM_MAP_HUGE | VMM_FLAG_PS);
+    uint64_t* pt = NULL;
+    uint64_t done = 0;
+    int res = 0;
+    while (done < npages) {
+        uint64_t va = virt + done * PAGE_SIZE;
+        int pt_i = (va >> 12) & 0x1FF;
+        if (huge && pt_i == 0 && npages - done >= HUGE_PAGE_FRAMES &&
+            (alloc || !((phys + done * PAGE_SIZE) & (HUGE_PAGE_SIZE - 1)))) {
+            uint64_t* pdt = get_pdt_space(space, va, 1, range_table_flags(flags));
+            if (!pdt) { res = -2; break; }
+            uint64_t* pde = &pdt[(va >> 21) & 0x1FF];
+            if (!(*pde & VMM_FLAG_PRESENT)) {
+                uint64_t pa = alloc ? alloc_huge_frame() : phys + done * PAGE_SIZE;
+                if (pa) {
+                    *pde = (pa & ADDRESS_MASK) | flags | VMM_FLAG_PS | VMM_FLAG_PRESENT;
+                    done += HUGE_PAGE_FRAMES;
+                    pt = NULL;
+                    continue;
+                }
+                // No free 2MB block: this window falls back to 4KB pages
+            }
+        }
+        if (!pt || pt_i == 0) {
+            pt = range_pt(space, va, 1, flags);
+            if (!pt) { res = -2; break; }
+        }
+        if (pt[pt_i] & VMM_FLAG_PRESENT) { res = -3; break; } // already mapped
+        uint64_t pa = alloc ? (uint64_t)range_frame(space) : phys + done * PAGE_SIZE;
+        if (!pa) { res = -4; break; }
+        pt[pt_i] = (pa & ADDRESS_MASK) | flags | VMM_FLAG_PRESENT;
+        done++;
+    }
+    // Present entries only replaced non-present ones: nothing to flush. On failure the
+    // pages mapped so far are taken down again (allocated frames go back to the PMM).
+    if (res != 0 && done) range_clear(space, virt, done, alloc);
+    return res;
+}
+
+// Unmap npages starting at virt, dropping one reference per frame like
+// vmm_unmap_in_space(). Holes are skipped: a missing PT skips to the next 2MB.
+// The whole range is flushed as one TLB batch (vmm_tlb_gather_end): invlpg per page for
+// short ranges, one context flush for long ones. Frames are released only after the flush
+// and the shootdown, so no CPU can write through a stale entry into a reused frame.
+uint64_t vmm_unmap_range(vmm_space_t* space, uint64_t virt, uint64_t npages) {
+    if (!space) space = &kernel_space;
+    if (virt & 0xFFF) return 0;
+    return range_clear(space, virt, npages, 1);
+}
+
+// Physical address behind virt, 4KB or 2MB leaf (0 if not mapped)
+static uint64_t translate_space(vmm_space_t* space, uint64_t virt) {
+    uint64_t* pdt = get_pdt_space(space, virt, 0, 0);
+    if (!pdt) return 0;
+    uint64_t pde = pdt[(virt >> 21) & 0x1FF];
+    if (!(pde & VMM_FLAG_PRESENT)) return 0;
+    if (pde & VMM_FLAG_PS) return (pde & ADDRESS_MASK & ~(HUGE_PAGE_SIZE - 1)) | (virt & (HUGE_PAGE_SIZE - 1));
+    uint64_t pte = table_ptr(pde)[(virt >> 12) & 0x1FF];
+    if (!(pte & VMM_FLAG_PRESENT)) return 0;
+    return (pte & ADDRESS_MASK) | (virt & 0xFFF);
+}
+
 uint64_t vmm_translate(uint64_t virt) {
-    uint64_t* pt = get_pt(virt, 0, 0);
-    if (!pt) return 0;
-    int pt_i = (virt >> 12) & 0x1FF;
-    if (!(pt[pt_i] & VMM_FLAG_PRESENT)) return 0;
-    return (pt[pt_i] & ADDRESS_MASK) | (virt & 0xFFF);
+    return translate_space(&kernel_space, virt);
 }
 
 uint64_t vmm_translate_in_space(vmm_space_t* space, uint64_t virt) {
     if (!space) return 0;
-    uint64_t* pt = get_pt_space(space, virt, 0, 0);
-    if (!pt) return 0;
-    int pt_i = (virt >> 12) & 0x1FF;
-    if (!(pt[pt_i] & VMM_FLAG_PRESENT)) return 0;
-    return (pt[pt_i] & ADDRESS_MASK) | (virt & 0xFFF);
+    return translate_space(space, virt);
 }
 
 int vmm_alloc_page(uint64_t virt, uint64_t flags) {
-    void* frame = pmm_alloc_frame();
+    void* frame = pmm_alloc_zeroed_frame();
     if (!frame) return -1;
-    zero_frame((uint64_t)frame);
     return vmm_map(virt, (uint64_t)frame, flags | VMM_FLAG_RW);
 }
 
 int vmm_alloc_page_in_space(vmm_space_t* space, uint64_t virt, uint64_t flags) {
     if (!space) return -10;
-    void* frame = pmm_alloc_frame(); if (!frame) return -1;
-    zero_frame((uint64_t)frame);
+    void* frame = pmm_alloc_zeroed_frame(); if (!frame) return -1;
     return vmm_map_in_space(space, virt, (uint64_t)frame, flags | VMM_FLAG_RW);
 }
 
+// Fault injection for the clone error paths (spawn <pid> check): the n-th allocation made
+// by vmm_clone_space() (VMA node, PDT or PT) fails once; -1 = off
+static int clone_fail_at = -1;
+
+void vmm_clone_fail_at(int n) { clone_fail_at = n; }
+
+static int clone_alloc_fails(void) {
+    if (clone_fail_at < 0) return 0;
+    return clone_fail_at-- == 0;
+}
+
+// --- VMA tree ---
+// Per-space AVL tree of non-overlapping areas keyed by start: lookup, insert and clone
+// stay O(log n) / O(n) whatever the number of areas.
+static inline int32_t vma_height(const vmm_vma_t* v) { return v ? v->height : 0; }
+
+static inline void vma_update(vmm_vma_t* v) {
+    int32_t l = vma_height(v->left), r = vma_height(v->right);
+    v->height = (l > r ? l : r) + 1;
+}
+
+static vmm_vma_t* vma_rotate_right(vmm_vma_t* v) {
+    vmm_vma_t* l = v->left;
+    v->left = l->right;
+    l->right = v;
+    vma_update(v);
+    vma_update(l);
+    return l;
+}
+
+static vmm_vma_t* vma_rotate_left(vmm_vma_t* v) {
+    vmm_vma_t* r = v->right;
+    v->right = r->left;
+    r->left = v;
+    vma_update(v);
+    vma_update(r);
+    return r;
+}
+
+static vmm_vma_t* vma_balance(vmm_vma_t* v) {
+    vma_update(v);
+    int32_t bf = vma_height(v->left) - vma_height(v->right);
+    if (bf > 1) {
+        if (vma_height(v->left->left) < vma_height(v->left->right)) v->left = vma_rotate_left(v->left);
+        return vma_rotate_right(v);
+    }
+    if (bf < -1) {
+        if (vma_height(v->right->right) < vma_height(v->right->left)) v->right = vma_rotate_right(v->right);
+        return vma_rotate_left(v);
+    }
+    return v;
+}
+
+// Insert 'n' under 'v'; *overlap set (tree unchanged) when n intersects an existing area
+static vmm_vma_t* vma_insert(vmm_vma_t* v, vmm_vma_t* n, int* overlap) {
+    if (!v) return n;
+    if (n->end <= v->start) v->left = vma_insert(v->left, n, overlap);
+    else if (n->start >= v->end) v->right = vma_insert(v->right, n, overlap);
+    else { *overlap = 1; return v; }
+    return *overlap ? v : vma_balance(v);
+}
+
+static void vma_free_tree(vmm_vma_t* v) {
+    if (!v) return;
+    vma_free_tree(v->left);
+    vma_free_tree(v->right);
+    kmem_cache_free(vma_cache, v);
+}
+
+// Same shape as the source, so the copy is balanced too (NULL: out of memory, copy freed)
+static vmm_vma_t* vma_clone_tree(const vmm_vma_t* v, int* fail) {
+    if (!v || *fail) return NULL;
+    vmm_vma_t* n = clone_alloc_fails() ? NULL : (vmm_vma_t*)kmem_cache_alloc(vma_cache);
+    if (!n) { *fail = 1; return NULL; }
+    *n = *v;
+    n->left = vma_clone_tree(v->left, fail);
+    n->right = vma_clone_tree(v->right, fail);
+    if (*fail) { vma_free_tree(n->left); vma_free_tree(n->right); kmem_cache_free(vma_cache, n); return NULL; }
+    return n;
+}
+
+int vmm_vma_add(vmm_space_t* space, uint64_t start, uint64_t len, uint64_t flags) {
+    if (!space || !len) return -1;
+    if (!vma_cache) vma_cache = kmem_cache_create("vmm_vma", sizeof(vmm_vma_t), 8, NULL);
+    vmm_vma_t* n = (vmm_vma_t*)kmem_cache_alloc(vma_cache);
+    if (!n) return -2;
+    n->start = start & ~(PAGE_SIZE - 1);
+    n->end = (start + len + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+    n->flags = (flags & ~(VMM_MAP_HUGE | VMM_FLAG_COW)) | VMM_FLAG_PRESENT;
+    n->backing = VMM_VMA_ANON;
+    n->height = 1;
+    n->left = n->right = NULL;
+    int overlap = 0;
+    space->vmas = vma_insert(space->vmas, n, &overlap);
+    if (overlap) { kmem_cache_free(vma_cache, n); return -1; }
+    space->vma_count++;
+    return 0;
+}
+
+vmm_vma_t* vmm_vma_find(vmm_space_t* space, uint64_t addr) {
+    vmm_vma_t* v = space ? space->vmas : NULL;
+    while (v) {
+        if (addr < v->start) v = v->left;
+        else if (addr >= v->end) v = v->right;
+        else return v;
+    }
+    return NULL;
+}
+
+// Not-present fault inside a VMA whose protection allows the access: map a zeroed frame
+// (coloured for coloured spaces). Kernel-half addresses use the kernel space tree.
+// Returns 0 when handled, -1 otherwise.
+static int vma_fault(uint64_t addr, uint64_t error_code) {
+    vmm_space_t* space = (addr >> 47) ? &kernel_space : current_space;
+    vmm_vma_t* v = vmm_vma_find(space, addr);
+    if (!v) return -1;
+    if ((error_code & 2) && !(v->flags & VMM_FLAG_RW)) return -1;     // write to read-only area
+    if ((error_code & 4) && !(v->flags & VMM_FLAG_USER)) return -1;   // user access to kernel area
+    if ((error_code & 16) && (v->flags & VMM_FLAG_NOEXEC)) return -1; // fetch from NX area
+    return vmm_map_range(space, addr & ~(PAGE_SIZE - 1), VMM_MAP_ALLOC, 1, v->flags) == 0 ? 0 : -1;
+}
+
 vmm_space_t* vmm_get_kernel_space(void) { return &kernel_space; }
 
+// Copy-on-write clone of the user range of 'src': only the PDT and PT levels are duplicated.
+// Leaf pages (4KB and 2MB) are shared with one extra frame reference; writable ones become
+// read-only + VMM_FLAG_COW in both spaces and are copied on the first write fault.
+// Read-only pages (code) are shared as they are. Cost: O(page tables + mapped entries),
+// no page contents are copied.
 vmm_space_t* vmm_clone_space(vmm_space_t* src) {
-    (void)src; return NULL; // cloning stub (not implemented)
+    if (!src) return NULL;
+    vmm_space_t* dst = vmm_space_create_user();
+    if (!dst) return NULL;
+    dst->colour_mask = src->colour_mask;
+    vmm_tlb_gather_t g; // parent entries that lost RW
+    vmm_tlb_gather_begin(&g, src);
+    int vma_fail = 0;
+    dst->vmas = vma_clone_tree(src->vmas, &vma_fail);
+    if (vma_fail) { terminal_writestring("[VMM] clone: VMA alloc fail\n"); goto fail; }
+    dst->vma_count = src->vma_count;
+    uint64_t* src_pml4 = table_ptr(src->pml4_phys);
+    for (uint64_t gb = USER_CODE_BASE & ~((1ULL << 30) - 1); gb < USER_STACK_TOP; gb += (1ULL << 30)) {
+        uint64_t pml4e = src_pml4[(gb >> 39) & 0x1FF];
+        if (!(pml4e & VMM_FLAG_PRESENT)) continue;
+        uint64_t pdpte = table_ptr(pml4e)[(gb >> 30) & 0x1FF];
+        if (!(pdpte & VMM_FLAG_PRESENT) || (pdpte & VMM_FLAG_PS)) continue;
+        uint64_t* spdt = table_ptr(pdpte);
+        uint64_t* dpdt = clone_alloc_fails() ? NULL : get_pdt_space(dst, gb, 1, VMM_FLAG_USER | VMM_FLAG_RW);
+        if (!dpdt) { terminal_writestring("[VMM] clone: PDT alloc fail\n"); goto fail; }
+        for (int i = 0; i < PT_ENTRIES; i++) {
+            uint64_t pde = spdt[i];
+            if (!(pde & VMM_FLAG_PRESENT)) continue;
+            if (pde & VMM_FLAG_PS) {
+                if (pde & VMM_FLAG_RW) {
+                    spdt[i] = pde = (pde & ~VMM_FLAG_RW) | VMM_FLAG_COW;
+                    vmm_tlb_gather_add(&g, gb + ((uint64_t)i << 21), HUGE_PAGE_FRAMES);
+                }
+                uint64_t base = pde & ADDRESS_MASK & ~(HUGE_PAGE_SIZE - 1);
+                for (int k = 0; k < HUGE_PAGE_FRAMES; k++) pmm_page_get(base + (uint64_t)k * PAGE_SIZE);
+                dpdt[i] = pde;
+                continue;
+            }
+            void* frame = clone_alloc_fails() ? NULL : alloc_table_frame();
+            if (!frame) { terminal_writestring("[VMM] clone: PT alloc fail\n"); goto fail; }
+            uint64_t* spt = table_ptr(pde);
+            uint64_t* dpt = table_ptr((uint64_t)frame);
+            for (int j = 0; j < PT_ENTRIES; j++) {
+                uint64_t pte = spt[j];
+                if (!(pte & VMM_FLAG_PRESENT)) continue;
+                if (pte & VMM_FLAG_RW) {
+                    spt[j] = pte = (pte & ~VMM_FLAG_RW) | VMM_FLAG_COW;
+                    vmm_tlb_gather_add(&g, gb + ((uint64_t)i << 21) + ((uint64_t)j << 12), 1);
+                }
+                pmm_page_get(pte & ADDRESS_MASK);
+                dpt[j] = pte;
+            }
+            dpdt[i] = ((uint64_t)frame & ADDRESS_MASK) | (pde & ~ADDRESS_MASK);
+        }
+    }
+    // Parent entries lost RW: one TLB batch for the whole clone
+    vmm_tlb_gather_end(&g);
+    return dst;
+
+fail:
+    // Partial child: its teardown drops every frame reference taken so far. Parent pages
+    // already made COW stay read-only and regain RW on their next write (last reference).
+    vmm_tlb_gather_end(&g);
+    vmm_space_destroy(dst);
+    return NULL;
+}
+
+// Write fault on a present page of the active space: resolve copy-on-write.
+// Last reference: the page just becomes writable again. Otherwise copy it (a 2MB page is
+// copied whole when a 2MB block is free, else split and only the 4KB page is copied).
+// Returns 0 when handled, -1 when the page is not COW (a real protection fault).
+static int cow_fault(uint64_t addr) {
+    vmm_space_t cur = kernel_space;
+    cur.pml4_phys = read_cr3() & ADDRESS_MASK;
+    // Copies keep the space's cache colours like its demand-zero pages (range_frame). A 2MB
+    // page spans every colour, so a coloured space splits it and copies the 4KB page only.
+    uint64_t mask = (current_space->pml4_phys == cur.pml4_phys) ? current_space->colour_mask : 0;
+    uint64_t* pdt = get_pdt_space(&cur, addr, 0, 0);
+    if (!pdt) return -1;
+    uint64_t* pde = &pdt[(addr >> 21) & 0x1FF];
+    if (!(*pde & VMM_FLAG_PRESENT)) return -1;
+    if (*pde & VMM_FLAG_PS) {
+        if (!(*pde & VMM_FLAG_COW)) return -1;
+        uint64_t va2m = addr & ~(HUGE_PAGE_SIZE - 1);
+        uint64_t base = *pde & ADDRESS_MASK & ~(HUGE_PAGE_SIZE - 1);
+        int last = 1;
+        for (int k = 0; k < HUGE_PAGE_FRAMES && last; k++) last = pmm_page_refcount(base + (uint64_t)k * PAGE_SIZE) <= 1;
+        if (last) {
+            *pde = (*pde | VMM_FLAG_RW) & ~VMM_FLAG_COW;
+            __asm__ volatile("invlpg (%0)" :: "r"(va2m) : "memory");
+            return 0;
+        }
+        uint64_t copy = mask ? 0 : (uint64_t)pmm_alloc_frames(HUGE_PAGE_FRAMES, HUGE_PAGE_SIZE);
+        if (copy) {
+            copy_frames(copy, base, HUGE_PAGE_FRAMES);
+            *pde = (copy & ADDRESS_MASK) | (((*pde & ~ADDRESS_MASK) | VMM_FLAG_RW) & ~VMM_FLAG_COW);
+            __asm__ volatile("invlpg (%0)" :: "r"(va2m) : "memory");
+            for (int k = 0; k < HUGE_PAGE_FRAMES; k++) pmm_page_put(base + (uint64_t)k * PAGE_SIZE);
+            return 0;
+        }
+        if (!split_huge_pde(&cur, pde, va2m)) return -1;
+    }
+    uint64_t* pte = &table_ptr(*pde)[(addr >> 12) & 0x1FF];
+    if (!(*pte & VMM_FLAG_PRESENT) || !(*pte & VMM_FLAG_COW)) return -1;
+    uint64_t old = *pte & ADDRESS_MASK;
+    uint64_t page = addr & ~0xFFFULL;
+    if (pmm_page_refcount(old) <= 1) {
+        *pte = (*pte | VMM_FLAG_RW) & ~VMM_FLAG_COW;
+        __asm__ volatile("invlpg (%0)" :: "r"(page) : "memory");
+        return 0;
+    }
+    void* frame = mask ? pmm_alloc_coloured_frame(mask) : pmm_alloc_frame();
+    if (!frame) return -1;
+    copy_frames((uint64_t)frame, old, 1);
+    *pte = ((uint64_t)frame & ADDRESS_MASK) | (((*pte & ~ADDRESS_MASK) | VMM_FLAG_RW) & ~VMM_FLAG_COW);
+    __asm__ volatile("invlpg (%0)" :: "r"(page) : "memory");
+    pmm_page_put(old);
+    return 0;
+}
+
+void vmm_init_pcid(void) {
+    uint32_t eax = 1, ebx, ecx = 0, edx;
+    __asm__ volatile("cpuid" : "+a"(eax), "=b"(ebx), "+c"(ecx), "=d"(edx));
+    uint64_t cr4 = read_cr4();
+    if (edx & (1u << 13)) { cr4 |= CR4_PGE; pge_enabled = 1; }
+    // PCIDE may only be set while CR3[11:0] is zero (kernel space, PCID 0)
+    if ((ecx & (1u << 17)) && !(read_cr3() & 0xFFF)) { cr4 |= CR4_PCIDE; pcid_enabled = 1; }
+    write_cr4(cr4);
+    // INVPCID (leaf 7 EBX bit 10): TLB batches flush one PCID without switching to it
+    eax = 0; ecx = 0;
+    __asm__ volatile("cpuid" : "+a"(eax), "=b"(ebx), "+c"(ecx), "=d"(edx));
+    if (eax >= 7) {
+        eax = 7; ecx = 0;
+        __asm__ volatile("cpuid" : "+a"(eax), "=b"(ebx), "+c"(ecx), "=d"(edx));
+        if (ebx & (1u << 10)) invpcid_enabled = 1;
+    }
+    terminal_writestring("[OK] TLB: global pages ");
+    terminal_writestring(pge_enabled ? "on" : "off");
+    terminal_writestring(", PCID ");
+    terminal_writestring(pcid_enabled ? "on" : "off");
+    terminal_writestring(", INVPCID ");
+    terminal_writestring(invpcid_enabled ? "on\n" : "off\n");
+}
+
+int vmm_pcid_enabled(void) { return pcid_enabled; }
+
+// New PCID for a space whose generation is stale; on wrap start a new generation
+static void pcid_assign(vmm_space_t* space) {
+    if (pcid_next > PCID_MAX) {
+        pcid_generation++;
+        pcid_next = 1;
+        tlb_flush_all(); // entries of every old-generation PCID go at once
+    }
+    space->pcid = pcid_next++;
+    space->pcid_gen = pcid_generation;
 }
 
 int vmm_switch_space(vmm_space_t* space) {
     if (!space) return -1;
-    write_cr3(space->pml4_phys & ADDRESS_MASK);
+    uint64_t cr3 = space->pml4_phys & ADDRESS_MASK;
+    if (pcid_enabled) {
+        int fresh = 0;
+        if (space != &kernel_space && space->pcid_gen != pcid_generation) { pcid_assign(space); fresh = 1; }
+        cr3 |= space->pcid;
+        // Keep the PCID's entries unless the PCID is new or lost mappings while inactive
+        if (!fresh && !space->tlb_stale) cr3 |= CR3_NOFLUSH;
+        space->tlb_stale = 0;
+    }
+    write_cr3(cr3);
+    current_space = space;
     return 0;
 }
 
 void vmm_harden_user_space(vmm_space_t* space) {
     if (!space) return;
-    uint64_t* pml4 = (uint64_t*)(space->pml4_phys & ADDRESS_MASK);
+    uint64_t* pml4 = table_ptr(space->pml4_phys);
     for (int i=0;i<PT_ENTRIES;i++) {
         uint64_t e = pml4[i];
         if (!(e & VMM_FLAG_PRESENT)) continue;
@@ -538,26 +1396,12 @@ void vmm_dump_entry(uint64_t virt) {
     terminal_writestring(" -> phys 0x"); terminal_writestring(hex); terminal_writestring("\n");
 }
 
-// --- Region allocator stub ---
-typedef struct vmm_region { uint64_t start; uint64_t size; uint64_t flags; } vmm_region_t;
-static vmm_region_t regions[32];
-static int region_count = 0;
-
-int vmm_region_add(uint64_t start, uint64_t size, uint64_t flags) {
-    if (region_count >= 32) return -1;
-    regions[region_count++] = (vmm_region_t){start,size,flags};
-    return 0;
-}
-
-const vmm_region_t* vmm_region_find(uint64_t addr) {
-    for (int i=0;i<region_count;i++) {
-        if (addr >= regions[i].start && addr < regions[i].start + regions[i].size) return &regions[i];
-    }
-    return NULL;
-}
-
 // Page Fault handler (called by exception_handler for INT 14)
 void vmm_handle_page_fault(uint64_t fault_addr, uint64_t error_code) {
+    // Write to a present copy-on-write page: resolved silently (hot path after a clone)
+    if ((error_code & 3) == 3 && cow_fault(fault_addr) == 0) return;
+    // Not-present page inside a VMA: demand-zero, silent and O(log n)
+    if (!(error_code & 1) && vma_fault(fault_addr, error_code) == 0) return;
     terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_RED, VGA_COLOR_BLACK));
     terminal_writestring("[PAGEFAULT] address: ");
     char hex[17]; hex[16]='\0'; uint64_t v=fault_addr; char hc[]="0123456789ABCDEF"; for(int i=15;i>=0;i--){ hex[i]=hc[v & 0xF]; v >>=4; }
@@ -574,17 +1418,6 @@ void vmm_handle_page_fault(uint64_t fault_addr, uint64_t error_code) {
     if (error_code & 8) terminal_writestring("rsvd ");
     if (error_code & 16) terminal_writestring("instr ");
     terminal_writestring(")\n");
-
-    const vmm_region_t* r = vmm_region_find(fault_addr);
-    if (r && !(error_code & 1)) {
-    // Demand-zero page if page-aligned
-        uint64_t page = fault_addr & ~0xFFFULL;
-        if (vmm_alloc_page(page, r->flags) == 0) {
-            terminal_writestring("[PAGEFAULT] Demand alloc page -> OK\n");
-            return; // handler returns allowing execution to continue
-        }
-    terminal_writestring("[PAGEFAULT] Demand alloc failed\n");
-    }
     terminal_writestring("[PANIC] Unhandled page fault\n");
     while(1){ __asm__ volatile("hlt"); }
 }
@@ -19,11 +19,30 @@
 #define VMM_FLAG_DIRTY     (1ULL<<6)
 #define VMM_FLAG_PS        (1ULL<<7)  // Page size (used only in non-PT levels)
 #define VMM_FLAG_GLOBAL    (1ULL<<8)
+#define VMM_FLAG_COW       (1ULL<<10) // software bit: read-only shared page, copy on write
 #define VMM_FLAG_NOEXEC    (1ULL<<63) // NX bit (requires EFER.NXE enabled)
 
-// Address space structure (currently only physical PML4 pointer)
+// Virtual memory area: a range of a space whose pages are faulted in on first touch
+typedef struct vmm_vma {
+    uint64_t start;           // page aligned
+    uint64_t end;             // exclusive, page aligned
+    uint64_t flags;           // leaf protection of the faulted pages (VMM_FLAG_*)
+    uint32_t backing;         // VMM_VMA_ANON: zero-filled frames
+    int32_t height;           // AVL height (leaf = 1)
+    struct vmm_vma* left;
+    struct vmm_vma* right;
+} vmm_vma_t;
+#define VMM_VMA_ANON 0
+
+// Address space structure
 typedef struct vmm_space {
-    uint64_t pml4_phys;  // Physical frame of PML4
+    uint64_t pml4_phys;    // Physical frame of PML4
+    uint64_t colour_mask;  // allowed page colours for user frames (0 = any, see PMM_COLOURS)
+    uint64_t pcid_gen;     // PCID generation 'pcid' belongs to (0 = none assigned yet)
+    uint16_t pcid;         // TLB tag while CR4.PCIDE is on (0 = kernel space)
+    uint16_t tlb_stale;    // mappings dropped while inactive: next switch flushes the PCID
+    vmm_vma_t* vmas;       // AVL tree of demand-zero areas, keyed by start
+    uint32_t vma_count;
 } vmm_space_t;
 
 // Virtual base of physmap (chosen in unused high area)
@@ -32,6 +51,15 @@ typedef struct vmm_space {
 // Initialize physmap for all physical memory (rounded up to 2MB boundary)
 void vmm_init_physmap(void);
 void vmm_extend_physmap(uint64_t phys_end); // extend physmap if needed (2MB granularity)
+// Unmap the boot identity map above the kernel image and early PMM metadata (end of boot)
+void vmm_trim_identity_map(void);
+
+// Kernel heap: list-allocator arena followed by the vmalloc area, both in one PML4 slot
+// (512GB) created by heap_init() before any user space copies the kernel entries
+#define VMM_KHEAP_BASE    0xFFFFC90000000000ULL
+#define VMM_KHEAP_SIZE    (1ULL << 30)                        // 1GB arena for kmalloc
+#define VMM_VMALLOC_BASE  (VMM_KHEAP_BASE + VMM_KHEAP_SIZE)
+#define VMM_VMALLOC_SIZE  (63ULL << 30)                       // 63GB for vmalloc objects
 
 // Helper conversions
 static inline uint64_t phys_to_virt(uint64_t phys) { return VMM_PHYSMAP_BASE + phys; }
@@ -46,8 +74,54 @@ int vmm_map_in_space(vmm_space_t* space, uint64_t virt, uint64_t phys, uint64_t
 
 // Unmap a 4K page
 int vmm_unmap(uint64_t virt);
+
+// TLB gather: collect the ranges of one space whose translations were removed or weakened,
+// then flush once on close. Up to VMM_TLB_GATHER_PAGES pages: invlpg (or INVPCID for an
+// inactive PCID) per page; above that, or past VMM_TLB_GATHER_RANGES ranges, one
+// whole-context flush (INVPCID when available, else a CR3 reload / CR4.PGE toggle when
+// kernel-half or kernel-space entries are involved).
+// Frames the batch unmapped (leaves and page tables) are freed on close too, after the
+// local flush and the shootdown; a full free list flushes the batch early.
+#define VMM_TLB_GATHER_RANGES 16
+#define VMM_TLB_GATHER_PAGES  32
+#define VMM_TLB_GATHER_RUNS   16  // runs of contiguous private leaf frames
+#define VMM_TLB_GATHER_PUTS   32  // shared or pinned leaf frames (one reference each)
+#define VMM_TLB_GATHER_TABLES 16  // page-table frames
+typedef struct vmm_tlb_gather {
+    vmm_space_t* space;
+    uint64_t start[VMM_TLB_GATHER_RANGES];
+    uint64_t pages[VMM_TLB_GATHER_RANGES];
+    uint32_t nranges;
+    uint8_t global;      // kernel-half or kernel-space ranges: global entries may be cached
+    uint8_t overflow;    // ranges beyond the table: whole-context flush
+    uint64_t total_pages;
+    uint64_t run_start[VMM_TLB_GATHER_RUNS];
+    uint64_t run_count[VMM_TLB_GATHER_RUNS];
+    uint64_t put[VMM_TLB_GATHER_PUTS];
+    uint64_t table[VMM_TLB_GATHER_TABLES];
+    uint32_t nruns, nputs, ntables;
+} vmm_tlb_gather_t;
+void vmm_tlb_gather_begin(vmm_tlb_gather_t* g, vmm_space_t* space); // NULL = kernel space
+void vmm_tlb_gather_add(vmm_tlb_gather_t* g, uint64_t virt, uint64_t npages);
+void vmm_tlb_gather_end(vmm_tlb_gather_t* g);
+// Remote shootdown, called once per flushed batch (NULL while only the boot CPU runs)
+void vmm_set_tlb_shootdown(void (*fn)(const vmm_tlb_gather_t* g));
+// Unmap one kernel-space 4KB page, queueing its invalidation in 'g' (vmm_unmap = one-page batch)
+int vmm_unmap_gather(vmm_tlb_gather_t* g, uint64_t virt);
 int vmm_unmap_in_space(vmm_space_t* space, uint64_t virt);
 
+// Map/unmap npages contiguous pages with one table walk per 2MB (space NULL = kernel).
+// phys = VMM_MAP_ALLOC backs each page with a fresh zeroed frame (space colour applies),
+// otherwise the range maps phys.. contiguously. On failure nothing stays mapped.
+// VMM_MAP_HUGE in flags maps every 2MB-aligned 2MB window of the range with one PS entry
+// (falls back to 4KB pages when no 2MB block is free or the space is coloured).
+// vmm_unmap_range() drops one frame reference per page and returns the pages unmapped;
+// 2MB pages only partially covered are split first.
+#define VMM_MAP_ALLOC (~0ULL)
+#define VMM_MAP_HUGE  (1ULL<<9) // request flag (software-available bit), never stored
+int vmm_map_range(vmm_space_t* space, uint64_t virt, uint64_t phys, uint64_t npages, uint64_t flags);
+uint64_t vmm_unmap_range(vmm_space_t* space, uint64_t virt, uint64_t npages);
+
 // Translate virtual -> physical (return 0 if not mapped)
 uint64_t vmm_translate(uint64_t virt);
 uint64_t vmm_translate_in_space(vmm_space_t* space, uint64_t virt);
@@ -59,11 +133,23 @@ int vmm_alloc_page_in_space(vmm_space_t* space, uint64_t virt, uint64_t flags);
 // Get current kernel space
 vmm_space_t* vmm_get_kernel_space(void);
 
-// Clone space (stub)
+// VMAs: non-overlapping demand-zero areas of a space (O(log n) lookup in the fault path).
+// vmm_vma_add returns 0, -1 on overlap or empty range, -2 when out of memory.
+int vmm_vma_add(vmm_space_t* space, uint64_t start, uint64_t len, uint64_t flags);
+vmm_vma_t* vmm_vma_find(vmm_space_t* space, uint64_t addr);
+
+// Copy-on-write clone of the user range: page tables are duplicated, leaf pages shared
+// read-only (VMM_FLAG_COW) and copied on the first write fault
+// Any allocation failure returns NULL with the partial child destroyed.
 vmm_space_t* vmm_clone_space(vmm_space_t* src);
+void vmm_clone_fail_at(int n); // fault injection: n-th clone allocation fails (-1 = off)
 
-// Switch address space (load CR3)
+// Switch address space (load CR3). With PCIDs the TLB entries of the space survive
+// the switch unless they went stale while it was inactive.
 int vmm_switch_space(vmm_space_t* space);
+// Enable CR4.PGE (global kernel mappings) and CR4.PCIDE when CPUID reports them
+void vmm_init_pcid(void);
+int vmm_pcid_enabled(void);
 
 // Dump page mapping (debug)
 void vmm_dump_entry(uint64_t virt);
@@ -81,7 +167,10 @@ int vmm_map_user_code(uint64_t virt);         // RX
 int vmm_map_user_data(uint64_t virt);         // RW/NX
 uint64_t vmm_alloc_user_stack(int pages);     // allocate stack pages
 vmm_space_t* vmm_space_create_user(void);     // create new address space
-int vmm_space_destroy(vmm_space_t* space);    // destroy address space
+int vmm_space_destroy(vmm_space_t* space);    // destroy address space (tables, frames, PML4)
+uint64_t vmm_unmap_user(vmm_space_t* space);  // unmap the user range in one walk, returns pages
+uint64_t vmm_space_resident(vmm_space_t* space, uint32_t owner); // resident user pages (+ owner tag)
+uint64_t vmm_space_refs(vmm_space_t* space);  // sum of resident user frame refcounts
 // Hardening: remove USER bit from shared kernel entries
 void vmm_harden_user_space(vmm_space_t* space);
 
@@ -89,6 +178,6 @@ void vmm_harden_user_space(vmm_space_t* space);
 int vmm_alloc_user_page_in_space(vmm_space_t* space, uint64_t virt);
 int vmm_map_user_code_in_space(vmm_space_t* space, uint64_t virt);
 int vmm_map_user_data_in_space(vmm_space_t* space, uint64_t virt);
-uint64_t vmm_alloc_user_stack_in_space(vmm_space_t* space, int pages);
+uint64_t vmm_alloc_user_stack_in_space(vmm_space_t* space, int pages); // lazy (VMA), guard below
 
 #endif // VMM_H